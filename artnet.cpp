@@ -1,66 +1,262 @@
 #include "./artnet.h"
 #include "./color.h"
 #include "./fixture.h"
+#include "./scene.h"
 
-#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <utility>
 #include <vector>
 
 namespace ledstickler {
 
-static constexpr color_convert<uint8_t> convert;
-
-std::vector<std::vector<uint8_t>> create_artnet_output_packets(const fixture &f) {
-    std::vector<std::vector<uint8_t>> packets;
-
-    // https://art-net.org.uk/structure/streaming-packets/artdmx-packet-definition/
-	
-    constexpr uint16_t artnet_output_packet_id = 0x5000;
-    constexpr uint16_t artnet_output_packet_version = 14;
-    constexpr size_t artnet_dmx_len = 512;
-
-    uint16_t uni_index = 0;
-    auto iter = f.points.begin();
-    for (size_t len = f.points.size(); len > 0; ) {
-        size_t chunk_len = std::min(artnet_dmx_len / (3 * 2), len);
-        std::vector<std::pair<vec4, vec4>> chunk(iter, iter + off_t(chunk_len));
-        
-        std::vector<uint8_t> packet;
-
-        const std::string artnet("Art-Net");
-        std::copy(artnet.begin(), artnet.end(), std::back_inserter(packet));
-        packet.push_back(0);
-
-        packet.push_back(uint8_t( (artnet_output_packet_id >> 0) & 0xFF ));
-        packet.push_back(uint8_t( (artnet_output_packet_id >> 8) & 0xFF ));
-        packet.push_back(uint8_t( (artnet_output_packet_version >> 8 ) & 0xFF ));
-        packet.push_back(uint8_t( (artnet_output_packet_version >> 0 ) & 0xFF ));
-        packet.push_back(0); // seq 
-        packet.push_back(0); // phy 
-        packet.push_back(uint8_t( (f.universes[uni_index] >> 0 ) & 0xFF ));
-        packet.push_back(uint8_t( (f.universes[uni_index] >> 8 ) & 0xFF ));
-        packet.push_back(uint8_t( ( (chunk_len * 6 ) >> 8) & 0xFF ));
-        packet.push_back(uint8_t( ( (chunk_len * 6 ) >> 0) & 0xFF ));
-
-        size_t offset = 18;
-        for (auto item : chunk) {
-            const rgba<uint16_t> col(convert.CIELUV2LED(item.first));
-            packet.push_back(uint8_t( ( col.r >> 8 ) & 0xFF )); 
-            packet.push_back(uint8_t( ( col.r >> 0 ) & 0xFF )); 
-            packet.push_back(uint8_t( ( col.g >> 8 ) & 0xFF )); 
-            packet.push_back(uint8_t( ( col.g >> 0 ) & 0xFF )); 
-            packet.push_back(uint8_t( ( col.b >> 8 ) & 0xFF )); 
-            packet.push_back(uint8_t( ( col.b >> 0 ) & 0xFF )); 
-            offset += 6;
+artnet_output::artnet_output(const scene &s) {
+    // Universes listed by any fixture, per controller. Overflow universes
+    // must not land on one of these or on another overflow universe.
+    std::set<std::pair<uint32_t, uint16_t>> claimed;
+    for (const auto &sf : s.fixtures) {
+        if (!sf.f->name.size()) {
+            continue;
         }
-        
-        packets.push_back(packet);
+        for (uint16_t universe : sf.f->universes) {
+            claimed.insert({ sf.f->address.addr(), universe });
+        }
+    }
+    for (size_t index = 0; index < s.fixtures.size(); index++) {
+        const scene_fixture &sf = s.fixtures[index];
+        const fixture &f = *sf.f;
+        if (!f.name.size()) {
+            continue;
+        }
+        const size_t pixel_size = pixel_format_size(f.format);
+        const size_t per_universe = artnet_dmx_len / pixel_size;
+        uint16_t universe = f.universes.size() ? f.universes.front() : 0;
+        for (size_t off = 0, uni_index = 0; off < sf.count; uni_index++) {
+            if (uni_index < f.universes.size()) {
+                universe = f.universes[uni_index];
+            } else {
+                // Art-Net port addresses are 15 bits
+                universe = uint16_t(universe + 1);
+                if (universe > 0x7FFF || !claimed.insert({ f.address.addr(), universe }).second) {
+                    dropped += sf.count - off;
+                    break;
+                }
+            }
+            artnet_universe u;
+            u.f = &f;
+            u.fixture_index = uint32_t(index);
+            u.universe = universe;
+            u.format = f.format;
+            u.first = sf.first + off;
+            u.count = std::min(per_universe, sf.count - off);
+            // DMX length has to be even
+            const size_t len = (u.count * pixel_size + 1) & ~size_t(1);
+            u.size = artnet_dmx_header_size + len;
+            const auto header = make_artnet_dmx_header(universe, uint16_t(len));
+            std::copy(header.begin(), header.end(), u.packet.begin());
+            universes.push_back(u);
+            off += u.count;
+        }
+    }
+}
+
+std::vector<uint32_t> artnet_sync_addresses(std::vector<uint32_t> controllers, artnet_sync_mode mode, const ipv4 &broadcast) {
+    std::vector<uint32_t> addresses;
+    switch (mode) {
+        case artnet_sync_mode::none:
+            break;
+        case artnet_sync_mode::broadcast:
+            addresses.push_back(broadcast.addr());
+            break;
+        case artnet_sync_mode::per_controller:
+            addresses = std::move(controllers);
+            std::sort(addresses.begin(), addresses.end());
+            addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+            break;
+    }
+    return addresses;
+}
+
+static uint8_t *write16(uint8_t *dst, uint16_t v) {
+    *dst++ = uint8_t( ( v >> 8 ) & 0xFF );
+    *dst++ = uint8_t( ( v >> 0 ) & 0xFF );
+    return dst;
+}
+
+static uint8_t *write8(uint8_t *dst, uint16_t v) {
+    *dst++ = uint8_t( ( v >> 8 ) & 0xFF );
+    return dst;
+}
+
+template<pixel_format F> static void write_pixels(uint8_t *dst, const rgba<uint16_t> *src, size_t count) {
+    for (size_t c = 0; c < count; c++) {
+        rgba<uint16_t> col(src[c]);
+        if constexpr (F == pixel_format::rgb16) {
+            dst = write16(write16(write16(dst, col.r), col.g), col.b);
+        } else if constexpr (F == pixel_format::rgb8) {
+            dst = write8(write8(write8(dst, col.r), col.g), col.b);
+        } else if constexpr (F == pixel_format::grb16) {
+            dst = col.write_grb_bytes(dst);
+        } else if constexpr (F == pixel_format::grb8) {
+            dst = write8(write8(write8(dst, col.g), col.r), col.b);
+        } else {
+            // Move the common part of r, g and b to the white channel
+            const uint16_t w = std::min(col.r, std::min(col.g, col.b));
+            col.r = uint16_t(col.r - w);
+            col.g = uint16_t(col.g - w);
+            col.b = uint16_t(col.b - w);
+            if constexpr (F == pixel_format::rgbw16) {
+                dst = write16(write16(write16(write16(dst, col.r), col.g), col.b), w);
+            } else {
+                dst = write8(write8(write8(write8(dst, col.r), col.g), col.b), w);
+            }
+        }
+    }
+}
+
+void artnet_output::update(const scene &s, size_t index) {
+    artnet_universe &u = universes[index];
+    uint8_t *dst = u.packet.data() + artnet_dmx_header_size;
+    const rgba<uint16_t> *src = &s.leds[u.first];
+    switch (u.format) {
+        case pixel_format::rgb16:  write_pixels<pixel_format::rgb16>(dst, src, u.count); break;
+        case pixel_format::rgb8:   write_pixels<pixel_format::rgb8>(dst, src, u.count); break;
+        case pixel_format::grb16:  write_pixels<pixel_format::grb16>(dst, src, u.count); break;
+        case pixel_format::grb8:   write_pixels<pixel_format::grb8>(dst, src, u.count); break;
+        case pixel_format::rgbw16: write_pixels<pixel_format::rgbw16>(dst, src, u.count); break;
+        case pixel_format::rgbw8:  write_pixels<pixel_format::rgbw8>(dst, src, u.count); break;
+    }
+}
+
+void artnet_output::update(const scene &s) {
+    for (size_t c = 0; c < universes.size(); c++) {
+        update(s, c);
+    }
+}
+
+artnet_sequence::artnet_sequence(size_t universes) :
+    next(universes, 1) {
+}
+
+void artnet_sequence::stamp(size_t index, uint8_t *packet) {
+    packet[12] = next[index];
+    next[index] = next[index] == 255 ? 1 : uint8_t(next[index] + 1);
+}
+
+artnet_delta::artnet_delta(const artnet_output &output, uint64_t keepalive_frames) :
+    send(output.universes.size(), 1),
+    keepalive(keepalive_frames),
+    last(output.universes.size()),
+    last_frame(output.universes.size(), 0),
+    valid(output.universes.size(), 0) {
+}
+
+void artnet_delta::update(const artnet_output &output) {
+    suppressed = 0;
+    unchanged_fixtures = 0;
+    bool fixture_unchanged = true;
+    for (size_t c = 0; c < output.universes.size(); c++) {
+        const artnet_universe &u = output.universes[c];
+        const uint8_t *payload = u.packet.data() + artnet_dmx_header_size;
+        const size_t len = u.size - artnet_dmx_header_size;
+        const bool same = valid[c] && memcmp(last[c].data(), payload, len) == 0;
+        const bool stale = !keepalive || frame - last_frame[c] >= keepalive;
+        send[c] = !same || stale;
+        if (send[c]) {
+            memcpy(last[c].data(), payload, len);
+            last_frame[c] = frame;
+            valid[c] = 1;
+        } else {
+            suppressed++;
+        }
+
+        // Universes of a fixture are contiguous
+        fixture_unchanged = fixture_unchanged && !send[c];
+        if (c + 1 == output.universes.size() || output.universes[c + 1].fixture_index != u.fixture_index) {
+            unchanged_fixtures += fixture_unchanged ? 1 : 0;
+            fixture_unchanged = true;
+        }
+    }
+    suppressed_total += suppressed;
+    frame++;
+}
+
+artnet_layout::artnet_layout(const scene &s) :
+    points(s.size()),
+    slots(size_t(UINT16_MAX) + 1, no_slot) {
+    const artnet_output output(s);
+    // Packets only carry the universe number, one used by several
+    // controllers can not be told apart and is left unmapped
+    std::vector<uint8_t> uses(slots.size(), 0);
+    for (const auto &u : output.universes) {
+        uses[u.universe] = uint8_t(std::min(uses[u.universe] + 1, 2));
+    }
+    for (size_t c = 0; c < uses.size(); c++) {
+        ambiguous += uses[c] > 1 ? 1 : 0;
+    }
+    for (const auto &u : output.universes) {
+        if (uses[u.universe] > 1) {
+            continue;
+        }
+        slots[u.universe] = uint32_t(universes.size());
+        universes.push_back(u.universe);
+        const size_t pixel_size = pixel_format_size(u.format);
+        for (size_t c = 0; c < u.count; c++) {
+            point &p = points[u.first + c];
+            p.slot = slots[u.universe];
+            p.offset = uint16_t(c * pixel_size);
+            p.format = u.format;
+        }
+    }
+}
+
+static uint16_t read16(const uint8_t *p) {
+    return uint16_t((p[0] << 8) | p[1]);
+}
+
+static uint16_t read8(const uint8_t *p) {
+    return uint16_t(p[0] * 257);
+}
+
+rgba<uint16_t> artnet_read_pixel(const uint8_t *p, pixel_format format) {
+    switch (format) {
+        case pixel_format::rgb16:
+            return rgba<uint16_t>(read16(p + 0), read16(p + 2), read16(p + 4));
+        case pixel_format::rgb8:
+            return rgba<uint16_t>(read8(p + 0), read8(p + 1), read8(p + 2));
+        case pixel_format::grb16:
+            return rgba<uint16_t>(read16(p + 2), read16(p + 0), read16(p + 4));
+        case pixel_format::grb8:
+            return rgba<uint16_t>(read8(p + 1), read8(p + 0), read8(p + 2));
+        case pixel_format::rgbw16: {
+            const uint32_t w = read16(p + 6);
+            return rgba<uint16_t>(uint16_t(std::min(read16(p + 0) + w, 65535u)), uint16_t(std::min(read16(p + 2) + w, 65535u)), uint16_t(std::min(read16(p + 4) + w, 65535u)));
+        }
+        case pixel_format::rgbw8: {
+            const uint32_t w = read8(p + 3);
+            return rgba<uint16_t>(uint16_t(std::min(read8(p + 0) + w, 65535u)), uint16_t(std::min(read8(p + 1) + w, 65535u)), uint16_t(std::min(read8(p + 2) + w, 65535u)));
+        }
+    }
+    return rgba<uint16_t>();
+}
+
+uint16_t artnet_opcode(const uint8_t *data, size_t size) {
+    static constexpr uint8_t id[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+    if (size < 12 || memcmp(data, id, sizeof(id)) != 0) {
+        return 0;
+    }
+    return uint16_t(data[8] | (data[9] << 8));
+}
 
-        len -= chunk_len;
-        iter += off_t(chunk_len);
-        uni_index++;
+bool artnet_parse_dmx(const uint8_t *data, size_t size, uint16_t &universe, const uint8_t *&dmx, size_t &length) {
+    if (size < artnet_dmx_header_size || artnet_opcode(data, size) != artnet_op_dmx) {
+        return false;
     }
-    
-    return packets;
+    universe = uint16_t(data[14] | (data[15] << 8));
+    length = size_t((data[16] << 8) | data[17]);
+    dmx = data + artnet_dmx_header_size;
+    return length <= artnet_dmx_len && artnet_dmx_header_size + length <= size;
 }
 
 }
@@ -2,13 +2,124 @@
 #define _ARTNET_H_
 
 #include "./fixture.h"
+#include "./scene.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
 
 namespace ledstickler {
 
     constexpr uint16_t artnet_port = 6454;
     constexpr size_t artnet_sync_packet_size = 14;
+    constexpr size_t artnet_dmx_header_size = 18;
+    constexpr size_t artnet_dmx_len = 512;
+    constexpr size_t artnet_dmx_packet_size = artnet_dmx_header_size + artnet_dmx_len;
+
+    enum class artnet_sync_mode {
+        none,
+        per_controller, // one ArtSync per unique controller address
+        broadcast       // a single directed broadcast ArtSync
+    };
+
+    // Destination addresses for the per frame ArtSync, deduplicated once up front.
+    std::vector<uint32_t> artnet_sync_addresses(std::vector<uint32_t> controllers, artnet_sync_mode mode, const ipv4 &broadcast);
+
+    // One preallocated ArtDmx packet. The header is written once, update()
+    // only rewrites the DMX payload in place.
+    struct artnet_universe {
+        const fixture *f = nullptr;
+        uint32_t fixture_index = 0;
+        uint16_t universe = 0;
+        pixel_format format = pixel_format::rgb16;
+        size_t first = 0;
+        size_t count = 0;
+        size_t size = 0;
+        std::array<uint8_t, artnet_dmx_packet_size> packet = { 0 };
+    };
+
+    // Packet arena for all named fixtures of a scene, allocated once. Each
+    // universe carries as many whole pixels of the fixture's format as fit
+    // in 512 channels. Points past the fixture's listed universes continue
+    // on consecutive universe numbers after the last one, as long as no
+    // fixture on the same controller uses that number. The rest is dropped.
+    class artnet_output {
+    public:
+        explicit artnet_output(const scene &s);
+
+        void update(const scene &s, size_t index);
+        void update(const scene &s);
+
+        std::vector<artnet_universe> universes;
+        size_t dropped = 0; // points that found no free universe number
+    };
+
+    // ArtDmx sequence numbers, counted per universe from 1 to 255 since 0
+    // tells receivers to not reorder at all.
+    class artnet_sequence {
+    public:
+        explicit artnet_sequence(size_t universes);
 
-    std::vector<std::vector<uint8_t>> create_artnet_output_packets(const fixture &f);
+        // Writes the next sequence number of universe index into an ArtDmx header.
+        void stamp(size_t index, uint8_t *packet);
+
+    private:
+        std::vector<uint8_t> next;
+    };
+
+    // Remembers the last payload sent per universe so unchanged ones can be
+    // left off the wire. Every universe is still refreshed at least every
+    // keepalive_frames, receivers treat a silent universe as lost otherwise.
+    class artnet_delta {
+    public:
+        artnet_delta(const artnet_output &output, uint64_t keepalive_frames);
+
+        // Decides which universes of output go out this frame, see send.
+        void update(const artnet_output &output);
+
+        std::vector<uint8_t> send;
+        size_t suppressed = 0;          // universes held back this frame
+        size_t unchanged_fixtures = 0;  // fixtures with all of their universes held back
+        size_t suppressed_total = 0;
+
+    private:
+        uint64_t keepalive;
+        uint64_t frame = 0;
+        std::vector<std::array<uint8_t, artnet_dmx_len>> last;
+        std::vector<uint64_t> last_frame;
+        std::vector<uint8_t> valid;
+    };
+
+    constexpr std::array<uint8_t, artnet_dmx_header_size> make_artnet_dmx_header(uint16_t universe, uint16_t length) {
+        std::array<uint8_t, artnet_dmx_header_size> header = { 0 };
+
+        // https://art-net.org.uk/structure/streaming-packets/artdmx-packet-definition/
+
+        constexpr uint16_t artnet_output_packet_id = 0x5000;
+        constexpr uint16_t artnet_output_packet_version = 14;
+
+        header.at( 0) = 'A';
+        header.at( 1) = 'r';
+        header.at( 2) = 't';
+        header.at( 3) = '-';
+        header.at( 4) = 'N';
+        header.at( 5) = 'e';
+        header.at( 6) = 't';
+        header.at( 7) = 0;
+
+        header.at( 8) = (artnet_output_packet_id >> 0) & 0xFF;
+        header.at( 9) = (artnet_output_packet_id >> 8) & 0xFF;
+        header.at(10) = ( artnet_output_packet_version >> 8 ) & 0xFF;
+        header.at(11) = ( artnet_output_packet_version >> 0 ) & 0xFF;
+        header.at(12) = 0; // seq
+        header.at(13) = 0; // phy
+        header.at(14) = uint8_t( ( universe >> 0 ) & 0xFF );
+        header.at(15) = uint8_t( ( universe >> 8 ) & 0xFF );
+        header.at(16) = uint8_t( ( length >> 8 ) & 0xFF );
+        header.at(17) = uint8_t( ( length >> 0 ) & 0xFF );
+
+        return header;
+    }
 
     constexpr std::array<uint8_t, artnet_sync_packet_size> make_arnet_sync_packet() {
         std::array<uint8_t, artnet_sync_packet_size> packet = { 0 };
@@ -36,6 +147,47 @@ namespace ledstickler {
 
         return packet;
     }
+
+    // The inverse of artnet_output: where each point of a scene sits in the
+    // universes it sends, so received DMX can be turned back into colors.
+    // Universes are matched by number alone, each number gets one slot.
+    // Numbers used by more than one controller are ambiguous and their
+    // points stay unmapped.
+    class artnet_layout {
+    public:
+        static constexpr uint32_t no_slot = UINT32_MAX;
+
+        struct point {
+            uint32_t slot = no_slot;
+            uint16_t offset = 0;
+            pixel_format format = pixel_format::rgb16;
+        };
+
+        explicit artnet_layout(const scene &s);
+
+        uint32_t slot(uint16_t universe) const { return slots[universe]; }
+
+        std::vector<point> points;       // per scene point
+        std::vector<uint16_t> universes; // per slot
+        size_t ambiguous = 0;            // universe numbers left unmapped
+
+    private:
+        std::vector<uint32_t> slots;     // per universe number
+    };
+
+    // A pixel read back from DMX written by artnet_output. RGBW gets its
+    // white added back into r, g and b.
+    rgba<uint16_t> artnet_read_pixel(const uint8_t *dmx, pixel_format format);
+
+    constexpr uint16_t artnet_op_dmx = 0x5000;
+    constexpr uint16_t artnet_op_sync = 0x5200;
+
+    // OpCode of an Art-Net packet, 0 if data is not one.
+    uint16_t artnet_opcode(const uint8_t *data, size_t size);
+
+    // Universe and DMX payload of an ArtDmx packet, in place. Returns false
+    // for anything else or a length running past size.
+    bool artnet_parse_dmx(const uint8_t *data, size_t size, uint16_t &universe, const uint8_t *&dmx, size_t &length);
 }
 
 #endif  // #ifndef _ARTNET_H_
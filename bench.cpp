@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "./vec4.h"
+#include "./vec4f.h"
+#include "./gradient.h"
+#include "./color.h"
+#include "./timeline.h"
+#include "./fixture.h"
+#include "./artnet.h"
+#include "./effect.h"
+#include "./scene.h"
+#include "./serialize.h"
+
+// Every heap allocation in the process goes through here so the benchmarks
+// can report allocations per frame.
+static std::atomic<uint64_t> allocations { 0 };
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif  // #if defined(__GNUC__) && !defined(__clang__)
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif  // #if defined(__GNUC__) && !defined(__clang__)
+
+namespace ledstickler {
+
+static constexpr vec4 gradient_rainbow_data[] = {
+    srgb8_stop(rgba<uint8_t>{0xff,0x00,0x00}, 0.00),
+    srgb8_stop(rgba<uint8_t>{0xff,0xff,0x00}, 0.16),
+    srgb8_stop(rgba<uint8_t>{0x00,0xff,0x00}, 0.33),
+    srgb8_stop(rgba<uint8_t>{0x00,0xff,0xff}, 0.50),
+    srgb8_stop(rgba<uint8_t>{0x00,0x00,0xff}, 0.66),
+    srgb8_stop(rgba<uint8_t>{0xff,0x00,0xff}, 0.83),
+    srgb8_stop(rgba<uint8_t>{0xff,0x00,0x00}, 1.00)};
+static constexpr gradient gradient_rainbow(gradient_rainbow_data,7);
+
+struct benchGradient {
+    static vec4f calc(const span &, const point_ref &p, double time) {
+        return gradient_rainbow.repeat(float(double(p.unit.z) + double(p.unit.x) * 0.5 + time * 0.1));
+    }
+};
+
+struct benchCrossFade {
+    static vec4f blend(const vec4f &top, const vec4f &btm, float in_f, float out_f) {
+        return vec4f::lerp(btm, top, in_f * out_f);
+    }
+};
+
+struct result {
+    double ns_per_iter = 0.0;
+    double allocs_per_iter = 0.0;
+    size_t iters = 0;
+};
+
+// Runs func until both min_iters and min_seconds are reached, after one
+// untimed warm up call.
+template<typename F> static result measure(const F &func, size_t min_iters = 8, double min_seconds = 0.25) {
+    using clock = std::chrono::steady_clock;
+    func();
+    result r;
+    const uint64_t allocs0 = allocations.load(std::memory_order_relaxed);
+    const clock::time_point start = clock::now();
+    double elapsed = 0.0;
+    while (r.iters < min_iters || elapsed < min_seconds) {
+        func();
+        r.iters++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+    r.ns_per_iter = elapsed * 1e9 / double(r.iters);
+    r.allocs_per_iter = double(allocations.load(std::memory_order_relaxed) - allocs0) / double(r.iters);
+    return r;
+}
+
+// Synthetic rig: fixture_count named fixtures on a square grid, each a
+// vertical strip of points, the total spread evenly.
+static fixture make_rig(size_t points, size_t fixture_count) {
+    fixture root;
+    const size_t side = size_t(std::ceil(std::sqrt(double(fixture_count))));
+    uint16_t universe = 0;
+    for (size_t f = 0; f < fixture_count; f++) {
+        const size_t count = points / fixture_count + (f < points % fixture_count ? 1 : 0);
+        fixture strip { ipv4 { 10, uint8_t((f >> 16) & 0xFF), uint8_t((f >> 8) & 0xFF), uint8_t(f & 0xFF) }, fmt::format("S{:05}", f), universe };
+        vec4 pos(double(f % side) * 1000.0, double(f / side) * 1000.0, 0.0, double(f));
+        for (size_t c = 0; c < count; c++) {
+            strip.push(pos);
+            pos += vec4(0.0, 0.0, 15.0, 0.0);
+        }
+        universe = uint16_t(universe + (count + 84) / 85);
+        root.push(strip);
+    }
+    return root;
+}
+
+// Nests depth timelines, each with one span and a cross fade onto its parent.
+static timeline make_show(size_t depth) {
+    timeline t { timing { 0.0, 1000.0 }, span { timing { 0.0, 1000.0 }, effect_of<benchGradient>() } };
+    for (size_t c = 1; c < depth; c++) {
+        t = timeline { timing { 0.0, 1000.0, 1.0, 1.0 }, span { timing { 0.0, 1000.0 }, effect_of<benchGradient>() }, t, blender_of<benchCrossFade>() };
+    }
+    return t;
+}
+
+static bool selected(const std::string &filter, const char *name) {
+    return filter.empty() || std::string(name).find(filter) != std::string::npos;
+}
+
+static void bench_gradient() {
+    std::vector<vec4f> out(1 << 16);
+    const result rd = measure([&out] {
+        for (size_t c = 0; c < out.size(); c++) {
+            out[c] = vec4f(gradient_rainbow.repeat(double(c) * (1.0 / 4096.0)));
+        }
+    });
+    fmt::print("{{\"bench\":\"gradient_repeat_double\",\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n", rd.ns_per_iter / double(out.size()), rd.allocs_per_iter);
+    const result rf = measure([&out] {
+        for (size_t c = 0; c < out.size(); c++) {
+            out[c] = gradient_rainbow.repeat(float(c) * (1.0f / 4096.0f));
+        }
+    });
+    fmt::print("{{\"bench\":\"gradient_repeat_float\",\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n", rf.ns_per_iter / double(out.size()), rf.allocs_per_iter);
+    std::vector<float> in(out.size());
+    for (size_t c = 0; c < in.size(); c++) {
+        in[c] = float(c) * (1.0f / 4096.0f);
+    }
+    const result rb = measure([&in, &out] { gradient_rainbow.repeat(in.data(), out.data(), in.size()); });
+    fmt::print("{{\"bench\":\"gradient_repeat_batch\",\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n", rb.ns_per_iter / double(out.size()), rb.allocs_per_iter);
+}
+
+// Largest channel difference between out and ref, in 16 bit LSB.
+static int max_error(const std::vector<rgba<uint16_t>> &out, const std::vector<rgba<uint16_t>> &ref) {
+    int err = 0;
+    for (size_t c = 0; c < out.size(); c++) {
+        err = std::max(err, std::abs(int(out[c].r) - int(ref[c].r)));
+        err = std::max(err, std::abs(int(out[c].g) - int(ref[c].g)));
+        err = std::max(err, std::abs(int(out[c].b) - int(ref[c].b)));
+    }
+    return err;
+}
+
+// Returns false if a batch kernel strays further from the scalar reference
+// than color.h promises.
+static bool bench_color() {
+    const size_t n = 1 << 16;
+    std::vector<vec4> in(n);
+    std::vector<vec4f> inf(n);
+    std::vector<rgba<uint16_t>> out(n);
+    std::vector<rgba<uint16_t>> ref(n);
+    for (size_t c = 0; c < n; c++) {
+        in[c] = gradient_rainbow.repeat(double(c) / double(n)) * (double(c % 256) / 255.0);
+        inf[c] = vec4f(in[c]);
+    }
+    static constexpr color_convert<uint16_t> convert;
+    const result rs = measure([&in, &ref] {
+        for (size_t c = 0; c < in.size(); c++) {
+            ref[c] = rgba<uint16_t>(convert.CIELUV2LED(in[c]));
+        }
+    });
+    fmt::print("{{\"bench\":\"color_convert_scalar\",\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n", rs.ns_per_iter / double(n), rs.allocs_per_iter);
+
+    static constexpr int double_bound = 1;
+    static constexpr int float_bound = 4;
+    const result rb = measure([&in, &out] { CIELUV2LED(in.data(), out.data(), in.size()); });
+    const int double_error = max_error(out, ref);
+    fmt::print("{{\"bench\":\"color_convert_batch_double\",\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f},\"max_error_lsb\":{},\"bound_lsb\":{}}}\n",
+        rb.ns_per_iter / double(n), rb.allocs_per_iter, double_error, double_bound);
+    const result rf = measure([&inf, &out] { CIELUV2LED(inf.data(), out.data(), inf.size()); });
+    const int float_error = max_error(out, ref);
+    fmt::print("{{\"bench\":\"color_convert_batch_float\",\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f},\"max_error_lsb\":{},\"bound_lsb\":{}}}\n",
+        rf.ns_per_iter / double(n), rf.allocs_per_iter, float_error, float_bound);
+
+    if (double_error > double_bound || float_error > float_bound) {
+        fmt::print(stderr, "color conversion error exceeds its bound\n");
+        return false;
+    }
+    return true;
+}
+
+static void bench_scene(size_t points, size_t fixture_count) {
+    const fixture rig = make_rig(points, fixture_count);
+    const result r = measure([&rig] { scene s(rig); }, 2);
+    fmt::print("{{\"bench\":\"scene_build\",\"points\":{},\"fixtures\":{},\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n",
+        points, fixture_count, r.ns_per_iter / double(points), r.allocs_per_iter);
+}
+
+static void bench_packetize(size_t points, size_t fixture_count) {
+    const fixture rig = make_rig(points, fixture_count);
+    const scene s(rig);
+    artnet_output output(s);
+    const result r = measure([&s, &output] { output.update(s); });
+    fmt::print("{{\"bench\":\"artnet_packetize\",\"points\":{},\"fixtures\":{},\"universes\":{},\"ns_per_point\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n",
+        points, fixture_count, output.universes.size(), r.ns_per_iter / double(points), r.allocs_per_iter);
+}
+
+static void bench_render(size_t points, size_t fixture_count, size_t depth) {
+    const fixture rig = make_rig(points, fixture_count);
+    scene s(rig);
+    const timeline show = make_show(depth);
+    render_context ctx(show);
+    double time = 0.0;
+    const result r = measure([&s, &show, &ctx, &time] {
+        show.render(s, time, ctx);
+        time += 0.01;
+    });
+    fmt::print("{{\"bench\":\"render\",\"points\":{},\"fixtures\":{},\"depth\":{},\"threads\":{},\"frames\":{},\"ns_per_point\":{:.3f},\"frames_per_sec\":{:.1f},\"allocs_per_frame\":{:.2f}}}\n",
+        points, fixture_count, depth, ctx.pool.size(), r.iters, r.ns_per_iter / double(points), 1e9 / r.ns_per_iter, r.allocs_per_iter);
+}
+
+static void bench_serialize(size_t points) {
+    const fixture rig = make_rig(points, 16);
+    const scene s(rig);
+    fmt::memory_buffer text;
+    const result rj = measure([&s, &text] { write_json(s, text); });
+    fmt::print("{{\"bench\":\"serialize_json\",\"points\":{},\"bytes\":{},\"ms_per_dump\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n",
+        points, text.size(), rj.ns_per_iter / 1e6, rj.allocs_per_iter);
+    std::vector<uint8_t> binary;
+    const result rg = measure([&s, &binary] { write_geometry(s, binary); });
+    fmt::print("{{\"bench\":\"serialize_geometry\",\"points\":{},\"bytes\":{},\"ms_per_dump\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n",
+        points, binary.size(), rg.ns_per_iter / 1e6, rg.allocs_per_iter);
+    const result rf = measure([&s, &binary] { write_frame(s, 1.0, binary); });
+    fmt::print("{{\"bench\":\"serialize_frame\",\"points\":{},\"bytes\":{},\"ms_per_dump\":{:.3f},\"allocs_per_iter\":{:.2f}}}\n",
+        points, binary.size(), rf.ns_per_iter / 1e6, rf.allocs_per_iter);
+}
+
+}  // namespace ledstickler {
+
+// Prints one JSON object per line. An optional argument only runs the
+// benchmarks whose name contains it.
+int main(int argc, char *argv[]) {
+    using namespace ledstickler;
+
+    const std::string filter = argc > 1 ? argv[1] : "";
+
+    if (selected(filter, "gradient")) {
+        bench_gradient();
+    }
+    bool ok = true;
+    if (selected(filter, "color")) {
+        ok = bench_color() && ok;
+    }
+    if (selected(filter, "scene")) {
+        for (size_t points : { 1'000, 10'000, 100'000, 1'000'000 }) {
+            bench_scene(points, 16);
+        }
+    }
+    if (selected(filter, "packetize")) {
+        for (size_t points : { 1'000, 10'000, 100'000, 1'000'000 }) {
+            bench_packetize(points, 16);
+        }
+    }
+    if (selected(filter, "serialize")) {
+        for (size_t points : { 1'000, 10'000, 100'000 }) {
+            bench_serialize(points);
+        }
+    }
+    if (selected(filter, "render")) {
+        for (size_t points : { 1'000, 10'000, 100'000, 1'000'000 }) {
+            bench_render(points, 16, 2);
+        }
+        for (size_t depth : { 1, 4, 8 }) {
+            bench_render(100'000, 16, depth);
+        }
+        for (size_t fixture_count : { 1, 256, 4096 }) {
+            bench_render(100'000, fixture_count, 2);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
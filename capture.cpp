@@ -0,0 +1,397 @@
+#include "./capture.h"
+#include "./color.h"
+#include "./metrics.h"
+#include "./sender.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else  // #if defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // #if defined(_WIN32)
+
+namespace ledstickler {
+
+static size_t align8(size_t v) {
+    return (v + 7) & ~size_t(7);
+}
+
+capture_writer::~capture_writer() {
+    close();
+}
+
+bool capture_writer::open(const std::string &path) {
+    close();
+
+    capture_file_header head;
+    head.start_unix_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    start_ns = metrics::now();
+    packet_count = 0;
+
+#if defined(_WIN32)
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    buffer.resize(size_t(1) << 20);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    if (fwrite(&head, 1, sizeof(head), file) != sizeof(head)) {
+        close();
+        return false;
+    }
+#else  // #if defined(_WIN32)
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    used = 0;
+    if (!reserve(sizeof(head))) {
+        close();
+        return false;
+    }
+    memcpy(base, &head, sizeof(head));
+#endif  // #if defined(_WIN32)
+    used = sizeof(head);
+    return true;
+}
+
+#if !defined(_WIN32)
+// Grows the file and its mapping in 64MB steps, new space reads as zeros
+// and so as the end of the data.
+bool capture_writer::reserve(size_t size) {
+    if (used + size <= capacity) {
+        return true;
+    }
+    static constexpr size_t step = size_t(64) << 20;
+    const size_t grown = (used + size + step - 1) / step * step;
+    if (ftruncate(fd, off_t(grown)) != 0) {
+        return false;
+    }
+    if (base) {
+        munmap(base, capacity);
+        base = nullptr;
+    }
+    void *p = mmap(nullptr, grown, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        capacity = 0;
+        return false;
+    }
+    base = static_cast<uint8_t *>(p);
+    capacity = grown;
+    return true;
+}
+#else  // #if !defined(_WIN32)
+bool capture_writer::reserve(size_t) {
+    return file != nullptr;
+}
+#endif  // #if !defined(_WIN32)
+
+bool capture_writer::write(const received_packet &packet) {
+    capture_record rec;
+    rec.time_ns = packet.time_ns > start_ns ? packet.time_ns - start_ns : 0;
+    rec.address = packet.address;
+    rec.size = uint16_t(std::min(packet.size, size_t(UINT16_MAX)));
+    if (rec.size == 0) {
+        return true;
+    }
+    const size_t total = sizeof(rec) + align8(rec.size);
+#if defined(_WIN32)
+    static constexpr uint8_t padding[8] = { 0 };
+    if (!file ||
+        fwrite(&rec, 1, sizeof(rec), file) != sizeof(rec) ||
+        fwrite(packet.data, 1, rec.size, file) != rec.size ||
+        fwrite(padding, 1, total - sizeof(rec) - rec.size, file) != total - sizeof(rec) - rec.size) {
+        return false;
+    }
+#else  // #if defined(_WIN32)
+    if (fd < 0 || !reserve(total)) {
+        return false;
+    }
+    // Payload first, a record only counts once its size is in place
+    memcpy(base + used + sizeof(rec), packet.data, rec.size);
+    memcpy(base + used, &rec, sizeof(rec));
+#endif  // #if defined(_WIN32)
+    used += total;
+    packet_count++;
+    return true;
+}
+
+bool capture_writer::close() {
+    const uint64_t data_size = used > sizeof(capture_file_header) ? used - sizeof(capture_file_header) : 0;
+    bool ok = true;
+#if defined(_WIN32)
+    if (!file) {
+        return true;
+    }
+    ok = fseek(file, offsetof(capture_file_header, data_size), SEEK_SET) == 0 && fwrite(&data_size, 1, sizeof(data_size), file) == sizeof(data_size);
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+#else  // #if defined(_WIN32)
+    if (fd < 0) {
+        return true;
+    }
+    if (base) {
+        memcpy(base + offsetof(capture_file_header, data_size), &data_size, sizeof(data_size));
+        munmap(base, capacity);
+    }
+    ok = ftruncate(fd, off_t(used)) == 0;
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+    base = nullptr;
+    capacity = 0;
+#endif  // #if defined(_WIN32)
+    used = 0;
+    return ok;
+}
+
+capture_file::~capture_file() {
+    close();
+}
+
+bool capture_file::open(const std::string &path) {
+    close();
+
+#if defined(_WIN32)
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(f, &size);
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+    length = size_t(size.QuadPart);
+    base = static_cast<const uint8_t *>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+#else  // #if defined(_WIN32)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    length = size_t(st.st_size);
+    void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        length = 0;
+        return false;
+    }
+    base = static_cast<const uint8_t *>(p);
+#endif  // #if defined(_WIN32)
+
+    static const capture_file_header expected;
+    capture_file_header head;
+    if (!base || length < sizeof(head)) {
+        close();
+        return false;
+    }
+    memcpy(&head, base, sizeof(head));
+    if (memcmp(head.magic, expected.magic, sizeof(expected.magic)) != 0 || head.version != expected.version) {
+        close();
+        return false;
+    }
+
+    // Stops at the first incomplete or empty record
+    size_t offset = sizeof(head);
+    while (offset + sizeof(capture_record) <= length) {
+        capture_record rec;
+        memcpy(&rec, base + offset, sizeof(rec));
+        if (rec.size == 0 || offset + sizeof(rec) + rec.size > length) {
+            break;
+        }
+        all.push_back({ rec.time_ns, rec.address, base + offset + sizeof(rec), rec.size });
+        offset += sizeof(rec) + align8(rec.size);
+    }
+
+    // Kernel timestamps within one receive batch are not strictly ordered
+    std::stable_sort(all.begin(), all.end(), [](const packet &a, const packet &b) { return a.time_ns < b.time_ns; });
+    const uint64_t first = all.size() ? all.front().time_ns : 0;
+    for (size_t c = 0; c < all.size(); c++) {
+        packet &item = all[c];
+        item.time_ns -= first;
+        uint16_t universe = 0;
+        const uint8_t *data = nullptr;
+        size_t len = 0;
+        if (artnet_parse_dmx(item.data, item.size, universe, data, len)) {
+            dmx[universe].push_back(uint32_t(c));
+        }
+    }
+    return true;
+}
+
+void capture_file::close() {
+#if defined(_WIN32)
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    mapping = nullptr;
+    file = nullptr;
+#else  // #if defined(_WIN32)
+    if (base) {
+        munmap(const_cast<uint8_t *>(base), length);
+    }
+#endif  // #if defined(_WIN32)
+    base = nullptr;
+    length = 0;
+    all.clear();
+    dmx.clear();
+}
+
+const capture_file::packet *capture_file::dmx_at(uint16_t universe, uint64_t time_ns) const {
+    auto it = dmx.find(universe);
+    if (it == dmx.end()) {
+        return nullptr;
+    }
+    const std::vector<uint32_t> &indices = it->second;
+    auto next = std::upper_bound(indices.begin(), indices.end(), time_ns, [this](uint64_t t, uint32_t index) { return t < all[index].time_ns; });
+    return next == indices.begin() ? nullptr : &all[*(next - 1)];
+}
+
+capture_layer::capture_layer(const capture_file &f, const scene &s) :
+    file(f),
+    layout(s) {
+}
+
+void capture_layer::evaluate(const span &, const point_batch &points, vec4f *out, double time) const {
+    const uint64_t t = time > 0.0 ? uint64_t(time * 1e9) : 0;
+    // Points of a batch share few universes, look each one up once per run
+    uint32_t slot = artnet_layout::no_slot;
+    const uint8_t *dmx = nullptr;
+    size_t length = 0;
+    for (size_t c = 0; c < points.count; c++) {
+        const artnet_layout::point &src = layout.points[points.first + c];
+        out[c] = vec4f();
+        if (src.slot == artnet_layout::no_slot) {
+            continue;
+        }
+        if (src.slot != slot) {
+            slot = src.slot;
+            dmx = nullptr;
+            length = 0;
+            if (const capture_file::packet *p = file.dmx_at(layout.universes[slot], t)) {
+                uint16_t u = 0;
+                artnet_parse_dmx(p->data, p->size, u, dmx, length);
+            }
+        }
+        if (!dmx || src.offset + pixel_format_size(src.format) > length) {
+            continue;
+        }
+        const rgba<uint16_t> col = artnet_read_pixel(dmx + src.offset, src.format);
+        out[c] = vec4f(color_convert<uint8_t>::LED2CIELUV(vec4(double(col.r), double(col.g), double(col.b)) * (1.0 / 65535.0)));
+        out[c].w = 1.0f;
+    }
+}
+
+static volatile std::sig_atomic_t capture_stop = 0;
+
+bool capture_artnet(const std::string &path, const capture_options &options) {
+    udp_receiver receiver;
+    if (!receiver.open(options.port)) {
+        fprintf(stderr, "could not listen on port %d\n", int(options.port));
+        return false;
+    }
+    capture_writer writer;
+    if (!writer.open(path)) {
+        fprintf(stderr, "could not create '%s'\n", path.c_str());
+        return false;
+    }
+
+    capture_stop = 0;
+    auto previous = std::signal(SIGINT, [](int) { capture_stop = 1; });
+
+    const uint64_t start = metrics::now();
+    const uint64_t end = options.duration > 0.0 ? start + uint64_t(options.duration * 1e9) : UINT64_MAX;
+    const uint64_t report_ns = uint64_t(std::max(options.report_interval, 0.1) * 1e9);
+    uint64_t next_report = start + report_ns;
+    uint64_t ignored = 0;
+    bool ok = true;
+
+    while (!capture_stop && ok) {
+        const uint64_t now = metrics::now();
+        if (now >= end) {
+            break;
+        }
+        if (now >= next_report) {
+            printf("captured (%llu) bytes (%llu) ignored (%llu) dropped (%llu)\n",
+                static_cast<unsigned long long>(writer.packets()), static_cast<unsigned long long>(writer.bytes()),
+                static_cast<unsigned long long>(ignored), static_cast<unsigned long long>(receiver.dropped()));
+            fflush(stdout);
+            next_report += report_ns;
+        }
+        const received_packet *packets = nullptr;
+        const size_t count = receiver.receive(packets, 100);
+        for (size_t c = 0; c < count && ok; c++) {
+            const uint16_t op = artnet_opcode(packets[c].data, packets[c].size);
+            if (op != artnet_op_dmx && op != artnet_op_sync) {
+                ignored++;
+                continue;
+            }
+            ok = writer.write(packets[c]);
+        }
+    }
+
+    std::signal(SIGINT, previous);
+    printf("captured (%llu) bytes (%llu) ignored (%llu) dropped (%llu)\n",
+        static_cast<unsigned long long>(writer.packets()), static_cast<unsigned long long>(writer.bytes()),
+        static_cast<unsigned long long>(ignored), static_cast<unsigned long long>(receiver.dropped()));
+    return writer.close() && ok;
+}
+
+bool replay_capture(const std::string &path, const replay_options &options) {
+    capture_file file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    udp_sender sender;
+    const size_t endpoint = sender.add_endpoint(options.target.addr(), options.port);
+    const std::vector<capture_file::packet> &packets = file.packets();
+
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+    send_stats stats;
+    for (size_t c = 0; c < packets.size(); ) {
+        const clock::time_point due = start + std::chrono::nanoseconds(packets[c].time_ns);
+        // Sleep most of the way, then yield up to the packet's time
+        if (due - clock::now() > std::chrono::milliseconds(2)) {
+            std::this_thread::sleep_until(due - std::chrono::milliseconds(1));
+        }
+        while (clock::now() < due) {
+            std::this_thread::yield();
+        }
+        const uint64_t elapsed = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+        for (; c < packets.size() && packets[c].time_ns <= elapsed; c++) {
+            sender.queue(endpoint, packets[c].data, packets[c].size);
+        }
+        stats += sender.flush();
+    }
+    printf("replayed (%llu) of (%llu) packets in %fs, errors (%llu)\n",
+        static_cast<unsigned long long>(stats.packets), static_cast<unsigned long long>(packets.size()),
+        double(file.duration_ns()) / 1e9, static_cast<unsigned long long>(stats.errors + stats.again));
+    return true;
+}
+
+}
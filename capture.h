@@ -0,0 +1,153 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "./effect.h"
+#include "./fixture.h"
+#include "./receiver.h"
+#include "./artnet.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ledstickler {
+
+    // Capture files are little endian and append only: a header, then one
+    // record per datagram, a capture_record followed by the datagram padded
+    // to 8 bytes. Record times are steady clock nanoseconds since the
+    // capture started. A record of size 0 ends the data early, which is how
+    // a capture that was never closed reads back.
+    struct capture_file_header {
+        char magic[8] = { 'L', 'S', 'C', 'A', 'P', 'T', 'U', 'R' };
+        uint32_t version = 1;
+        uint32_t reserved = 0;
+        uint64_t start_unix_ns = 0;
+        uint64_t data_size = 0;  // patched by close(), 0 if it never ran
+    };
+
+    struct capture_record {
+        uint64_t time_ns = 0;
+        uint32_t address = 0;
+        uint16_t size = 0;
+        uint16_t reserved = 0;
+    };
+
+    static_assert(sizeof(capture_file_header) == 32, "capture_file_header layout");
+    static_assert(sizeof(capture_record) == 16, "capture_record layout");
+
+    // Appends datagrams to a capture file. On POSIX systems the file is
+    // grown in large steps and written through a shared memory mapping, so
+    // a write is a memcpy and never a syscall.
+    class capture_writer {
+    public:
+        capture_writer() = default;
+        ~capture_writer();
+
+        capture_writer(const capture_writer &) = delete;
+        capture_writer &operator=(const capture_writer &) = delete;
+
+        // Returns false if path can not be created.
+        bool open(const std::string &path);
+        bool write(const received_packet &packet);
+        bool close();
+
+        uint64_t packets() const { return packet_count; }
+        uint64_t bytes() const { return used; }
+
+    private:
+        bool reserve(size_t size);
+
+        uint64_t start_ns = 0;
+        uint64_t packet_count = 0;
+        size_t used = 0;
+#if defined(_WIN32)
+        FILE *file = nullptr;
+        std::vector<char> buffer;
+#else  // #if defined(_WIN32)
+        int fd = -1;
+        uint8_t *base = nullptr;
+        size_t capacity = 0;
+#endif  // #if defined(_WIN32)
+    };
+
+    // Read only memory mapping of a capture file with an index of its
+    // packets. Times are rebased to the first packet.
+    class capture_file {
+    public:
+        struct packet {
+            uint64_t time_ns = 0;
+            uint32_t address = 0;
+            const uint8_t *data = nullptr;
+            size_t size = 0;
+        };
+
+        capture_file() = default;
+        ~capture_file();
+
+        capture_file(const capture_file &) = delete;
+        capture_file &operator=(const capture_file &) = delete;
+
+        // Returns false if path is missing or not a capture file.
+        bool open(const std::string &path);
+        void close();
+
+        const std::vector<packet> &packets() const { return all; }
+        uint64_t duration_ns() const { return all.size() ? all.back().time_ns : 0; }
+
+        // Latest ArtDmx for universe at or before time_ns, nullptr if none.
+        const packet *dmx_at(uint16_t universe, uint64_t time_ns) const;
+
+    private:
+        const uint8_t *base = nullptr;
+        size_t length = 0;
+#if defined(_WIN32)
+        void *file = nullptr;
+        void *mapping = nullptr;
+#endif  // #if defined(_WIN32)
+        std::vector<packet> all;
+        std::unordered_map<uint16_t, std::vector<uint32_t>> dmx;
+    };
+
+    // Effect playing a capture back onto the scene, so it can be merged
+    // into a timeline as a span. Points are matched to universes and
+    // channels the same way artnet_output packs them, by universe number
+    // only, and span time 0 is the first captured packet. Points with
+    // captured data get w = 1, points without stay black with w = 0, as do
+    // points of universe numbers several controllers share.
+    class capture_layer final : public effect {
+    public:
+        capture_layer(const capture_file &file, const scene &s);
+
+        void evaluate(const span &s, const point_batch &points, vec4f *out, double time) const override;
+
+        // Universe numbers used by several controllers, see artnet_layout.
+        size_t ambiguous_universes() const { return layout.ambiguous; }
+
+    private:
+        const capture_file &file;
+        artnet_layout layout;
+    };
+
+    struct capture_options {
+        uint16_t port = artnet_port;
+        double duration = 0.0; // seconds, 0 records until interrupted
+        double report_interval = 1.0;
+    };
+
+    struct replay_options {
+        ipv4 target = { 255, 255, 255, 255 };
+        uint16_t port = artnet_port;
+    };
+
+    // Records ArtDmx and ArtSync packets arriving on options.port into path
+    // until the duration is over or SIGINT. Returns false on socket or I/O errors.
+    bool capture_artnet(const std::string &path, const capture_options &options);
+
+    // Sends every captured packet to options.target with its original timing.
+    bool replay_capture(const std::string &path, const replay_options &options);
+
+}
+
+#endif  // #ifndef _CAPTURE_H_
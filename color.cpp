@@ -0,0 +1,285 @@
+#include "./color.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define COLOR_HAS_AVX2
+#include <immintrin.h>
+#endif  // #if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+#if defined(__aarch64__)
+#define COLOR_HAS_NEON
+#include <arm_neon.h>
+#endif  // #if defined(__aarch64__)
+
+namespace ledstickler {
+
+static constexpr color_convert<uint8_t> convert;
+
+static constexpr double wu = 0.197839825;
+static constexpr double wv = 0.468336303;
+static constexpr double C = ( 3.0 / 29.0 ) * ( 3.0 / 29.0 ) * ( 3.0 / 29.0 ) * 100.0;
+
+static void CIELUV2LED_scalar(const vec4 *in, rgba<uint16_t> *out, size_t n) {
+    for (size_t c = 0; c < n; c++) {
+        out[c] = rgba<uint16_t>(convert.CIELUV2LED(in[c]));
+    }
+}
+
+#if defined(COLOR_HAS_AVX2)
+
+__attribute__((target("avx2")))
+static void CIELUV2LED_avx2(const vec4 *in, rgba<uint16_t> *out, size_t n) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d scale = _mm256_set1_pd(65535.0);
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4) {
+        // AoS -> SoA for 4 points
+        const __m256d a = _mm256_loadu_pd(&in[c + 0].x);
+        const __m256d b = _mm256_loadu_pd(&in[c + 1].x);
+        const __m256d e = _mm256_loadu_pd(&in[c + 2].x);
+        const __m256d f = _mm256_loadu_pd(&in[c + 3].x);
+        const __m256d t0 = _mm256_unpacklo_pd(a, b);
+        const __m256d t1 = _mm256_unpackhi_pd(a, b);
+        const __m256d t2 = _mm256_unpacklo_pd(e, f);
+        const __m256d t3 = _mm256_unpackhi_pd(e, f);
+        const __m256d L = _mm256_permute2f128_pd(t0, t2, 0x20);
+        const __m256d U = _mm256_permute2f128_pd(t1, t3, 0x20);
+        const __m256d V = _mm256_permute2f128_pd(t0, t2, 0x31);
+        const __m256d W = _mm256_permute2f128_pd(t1, t3, 0x31);
+
+        const __m256d l13 = _mm256_mul_pd(_mm256_set1_pd(13.0), L);
+        const __m256d up_13l = _mm256_add_pd(U, _mm256_mul_pd(_mm256_set1_pd(wu), l13));
+        const __m256d vp_13l = _mm256_add_pd(V, _mm256_mul_pd(_mm256_set1_pd(wv), l13));
+        const __m256d vp_nz = _mm256_cmp_pd(vp_13l, zero, _CMP_NEQ_OQ);
+        const __m256d vp_13li = _mm256_and_pd(_mm256_div_pd(one, _mm256_blendv_pd(one, vp_13l, vp_nz)), vp_nz);
+
+        const __m256d Y = _mm256_mul_pd(_mm256_add_pd(L, _mm256_set1_pd(0.16)), _mm256_set1_pd(1.0 / 1.16));
+        const __m256d Y3 = _mm256_mul_pd(_mm256_mul_pd(Y, Y), Y);
+        const __m256d y = _mm256_blendv_pd(Y3, _mm256_mul_pd(L, _mm256_set1_pd(C)), _mm256_cmp_pd(L, _mm256_set1_pd(0.08), _CMP_LE_OQ));
+        const __m256d x = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.25), y), up_13l), vp_13li);
+        const __m256d zt = _mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(156.0), L), _mm256_mul_pd(_mm256_set1_pd(3.0), up_13l)), _mm256_mul_pd(_mm256_set1_pd(20.0), vp_13l));
+        const __m256d z = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(y, zt), _mm256_set1_pd(1.0 / 4.0)), vp_13li);
+
+        __m256d r = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd( 3.2404542), x), _mm256_mul_pd(_mm256_set1_pd(-1.5371385), y)), _mm256_mul_pd(_mm256_set1_pd(-0.4985314), z));
+        __m256d g = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(-0.9692660), x), _mm256_mul_pd(_mm256_set1_pd( 1.8760108), y)), _mm256_mul_pd(_mm256_set1_pd( 0.0415560), z));
+        __m256d bl = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd( 0.0556434), x), _mm256_mul_pd(_mm256_set1_pd(-0.2040259), y)), _mm256_mul_pd(_mm256_set1_pd( 1.0572252), z));
+
+        r = _mm256_mul_pd(_mm256_min_pd(_mm256_max_pd(r, zero), one), scale);
+        g = _mm256_mul_pd(_mm256_min_pd(_mm256_max_pd(g, zero), one), scale);
+        bl = _mm256_mul_pd(_mm256_min_pd(_mm256_max_pd(bl, zero), one), scale);
+        const __m256d al = _mm256_mul_pd(_mm256_min_pd(_mm256_max_pd(W, zero), one), scale);
+
+        // Truncate like rgba<uint16_t>::clamp_to_type and interleave back to r,g,b,a
+        const __m128i rg = _mm_packus_epi32(_mm256_cvttpd_epi32(r), _mm256_cvttpd_epi32(g));
+        const __m128i ba = _mm_packus_epi32(_mm256_cvttpd_epi32(bl), _mm256_cvttpd_epi32(al));
+        const __m128i rb = _mm_unpacklo_epi16(rg, ba);
+        const __m128i ga = _mm_unpackhi_epi16(rg, ba);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out[c + 0]), _mm_unpacklo_epi16(rb, ga));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out[c + 2]), _mm_unpackhi_epi16(rb, ga));
+    }
+    CIELUV2LED_scalar(in + c, out + c, n - c);
+}
+
+#endif  // #if defined(COLOR_HAS_AVX2)
+
+#if defined(COLOR_HAS_NEON)
+
+static void CIELUV2LED_neon(const vec4 *in, rgba<uint16_t> *out, size_t n) {
+    const float64x2_t zero = vdupq_n_f64(0.0);
+    const float64x2_t one = vdupq_n_f64(1.0);
+    const float64x2_t scale = vdupq_n_f64(65535.0);
+
+    size_t c = 0;
+    for (; c + 2 <= n; c += 2) {
+        // AoS -> SoA for 2 points
+        const float64x2x4_t p = vld4q_f64(&in[c].x);
+        const float64x2_t L = p.val[0];
+        const float64x2_t U = p.val[1];
+        const float64x2_t V = p.val[2];
+        const float64x2_t W = p.val[3];
+
+        const float64x2_t l13 = vmulq_n_f64(L, 13.0);
+        const float64x2_t up_13l = vaddq_f64(U, vmulq_n_f64(l13, wu));
+        const float64x2_t vp_13l = vaddq_f64(V, vmulq_n_f64(l13, wv));
+        const uint64x2_t vp_z = vceqq_f64(vp_13l, zero);
+        const float64x2_t vp_13li = vbslq_f64(vp_z, zero, vdivq_f64(one, vbslq_f64(vp_z, one, vp_13l)));
+
+        const float64x2_t Y = vmulq_n_f64(vaddq_f64(L, vdupq_n_f64(0.16)), 1.0 / 1.16);
+        const float64x2_t Y3 = vmulq_f64(vmulq_f64(Y, Y), Y);
+        const float64x2_t y = vbslq_f64(vcleq_f64(L, vdupq_n_f64(0.08)), vmulq_n_f64(L, C), Y3);
+        const float64x2_t x = vmulq_f64(vmulq_f64(vmulq_n_f64(y, 2.25), up_13l), vp_13li);
+        const float64x2_t zt = vsubq_f64(vsubq_f64(vmulq_n_f64(L, 156.0), vmulq_n_f64(up_13l, 3.0)), vmulq_n_f64(vp_13l, 20.0));
+        const float64x2_t z = vmulq_f64(vmulq_n_f64(vmulq_f64(y, zt), 1.0 / 4.0), vp_13li);
+
+        float64x2_t r = vaddq_f64(vaddq_f64(vmulq_n_f64(x,  3.2404542), vmulq_n_f64(y, -1.5371385)), vmulq_n_f64(z, -0.4985314));
+        float64x2_t g = vaddq_f64(vaddq_f64(vmulq_n_f64(x, -0.9692660), vmulq_n_f64(y,  1.8760108)), vmulq_n_f64(z,  0.0415560));
+        float64x2_t b = vaddq_f64(vaddq_f64(vmulq_n_f64(x,  0.0556434), vmulq_n_f64(y, -0.2040259)), vmulq_n_f64(z,  1.0572252));
+
+        r = vmulq_f64(vminq_f64(vmaxq_f64(r, zero), one), scale);
+        g = vmulq_f64(vminq_f64(vmaxq_f64(g, zero), one), scale);
+        b = vmulq_f64(vminq_f64(vmaxq_f64(b, zero), one), scale);
+        const float64x2_t a = vmulq_f64(vminq_f64(vmaxq_f64(W, zero), one), scale);
+
+        // Truncate like rgba<uint16_t>::clamp_to_type and interleave back to r,g,b,a
+        const uint16x4_t rg = vmovn_u32(vcombine_u32(vmovn_u64(vcvtq_u64_f64(r)), vmovn_u64(vcvtq_u64_f64(g))));
+        const uint16x4_t ba = vmovn_u32(vcombine_u32(vmovn_u64(vcvtq_u64_f64(b)), vmovn_u64(vcvtq_u64_f64(a))));
+        const uint16x4x2_t rb_ga = vzip_u16(rg, ba);
+        const uint16x4x2_t rgba_ = vzip_u16(rb_ga.val[0], rb_ga.val[1]);
+        vst1_u16(&out[c + 0].r, rgba_.val[0]);
+        vst1_u16(&out[c + 1].r, rgba_.val[1]);
+    }
+    CIELUV2LED_scalar(in + c, out + c, n - c);
+}
+
+#endif  // #if defined(COLOR_HAS_NEON)
+
+static void CIELUV2LED_scalar(const vec4f *in, rgba<uint16_t> *out, size_t n) {
+    for (size_t c = 0; c < n; c++) {
+        out[c] = rgba<uint16_t>(convert.CIELUV2LED(vec4(in[c])));
+    }
+}
+
+#if defined(VEC4F_SSE)
+
+static void CIELUV2LED_sse(const vec4f *in, rgba<uint16_t> *out, size_t n) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(65535.0f);
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(-0x8000);
+
+    auto select = [] (__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    };
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4) {
+        // AoS -> SoA for 4 points
+        __m128 L = _mm_load_ps(&in[c + 0].x);
+        __m128 U = _mm_load_ps(&in[c + 1].x);
+        __m128 V = _mm_load_ps(&in[c + 2].x);
+        __m128 W = _mm_load_ps(&in[c + 3].x);
+        _MM_TRANSPOSE4_PS(L, U, V, W);
+
+        const __m128 l13 = _mm_mul_ps(_mm_set1_ps(13.0f), L);
+        const __m128 up_13l = _mm_add_ps(U, _mm_mul_ps(_mm_set1_ps(float(wu)), l13));
+        const __m128 vp_13l = _mm_add_ps(V, _mm_mul_ps(_mm_set1_ps(float(wv)), l13));
+        const __m128 vp_nz = _mm_cmpneq_ps(vp_13l, zero);
+        const __m128 vp_13li = _mm_and_ps(_mm_div_ps(one, select(vp_nz, vp_13l, one)), vp_nz);
+
+        const __m128 Y = _mm_mul_ps(_mm_add_ps(L, _mm_set1_ps(0.16f)), _mm_set1_ps(float(1.0 / 1.16)));
+        const __m128 Y3 = _mm_mul_ps(_mm_mul_ps(Y, Y), Y);
+        const __m128 y = select(_mm_cmple_ps(L, _mm_set1_ps(0.08f)), _mm_mul_ps(L, _mm_set1_ps(float(C))), Y3);
+        const __m128 x = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.25f), y), up_13l), vp_13li);
+        const __m128 zt = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(156.0f), L), _mm_mul_ps(_mm_set1_ps(3.0f), up_13l)), _mm_mul_ps(_mm_set1_ps(20.0f), vp_13l));
+        const __m128 z = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(y, zt), _mm_set1_ps(0.25f)), vp_13li);
+
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps( 3.2404542f), x), _mm_mul_ps(_mm_set1_ps(-1.5371385f), y)), _mm_mul_ps(_mm_set1_ps(-0.4985314f), z));
+        __m128 g = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.9692660f), x), _mm_mul_ps(_mm_set1_ps( 1.8760108f), y)), _mm_mul_ps(_mm_set1_ps( 0.0415560f), z));
+        __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps( 0.0556434f), x), _mm_mul_ps(_mm_set1_ps(-0.2040259f), y)), _mm_mul_ps(_mm_set1_ps( 1.0572252f), z));
+
+        r = _mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale);
+        g = _mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale);
+        b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), scale);
+        const __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(W, zero), one), scale);
+
+        // SSE2 has no unsigned 32 -> 16 pack, bias into the signed range and back
+        const __m128i rg = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(r), bias), _mm_sub_epi32(_mm_cvttps_epi32(g), bias)), bias16);
+        const __m128i ba = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(b), bias), _mm_sub_epi32(_mm_cvttps_epi32(a), bias)), bias16);
+        const __m128i rb = _mm_unpacklo_epi16(rg, ba);
+        const __m128i ga = _mm_unpackhi_epi16(rg, ba);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out[c + 0]), _mm_unpacklo_epi16(rb, ga));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out[c + 2]), _mm_unpackhi_epi16(rb, ga));
+    }
+    CIELUV2LED_scalar(in + c, out + c, n - c);
+}
+
+#endif  // #if defined(VEC4F_SSE)
+
+#if defined(VEC4F_NEON)
+
+static void CIELUV2LED_neon(const vec4f *in, rgba<uint16_t> *out, size_t n) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t scale = vdupq_n_f32(65535.0f);
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4) {
+        // AoS -> SoA for 4 points
+        const float32x4x4_t p = vld4q_f32(&in[c].x);
+        const float32x4_t L = p.val[0];
+        const float32x4_t U = p.val[1];
+        const float32x4_t V = p.val[2];
+        const float32x4_t W = p.val[3];
+
+        const float32x4_t l13 = vmulq_n_f32(L, 13.0f);
+        const float32x4_t up_13l = vaddq_f32(U, vmulq_n_f32(l13, float(wu)));
+        const float32x4_t vp_13l = vaddq_f32(V, vmulq_n_f32(l13, float(wv)));
+        const uint32x4_t vp_z = vceqq_f32(vp_13l, zero);
+        const float32x4_t vp_13li = vbslq_f32(vp_z, zero, vdivq_f32(one, vbslq_f32(vp_z, one, vp_13l)));
+
+        const float32x4_t Y = vmulq_n_f32(vaddq_f32(L, vdupq_n_f32(0.16f)), float(1.0 / 1.16));
+        const float32x4_t Y3 = vmulq_f32(vmulq_f32(Y, Y), Y);
+        const float32x4_t y = vbslq_f32(vcleq_f32(L, vdupq_n_f32(0.08f)), vmulq_n_f32(L, float(C)), Y3);
+        const float32x4_t x = vmulq_f32(vmulq_f32(vmulq_n_f32(y, 2.25f), up_13l), vp_13li);
+        const float32x4_t zt = vsubq_f32(vsubq_f32(vmulq_n_f32(L, 156.0f), vmulq_n_f32(up_13l, 3.0f)), vmulq_n_f32(vp_13l, 20.0f));
+        const float32x4_t z = vmulq_f32(vmulq_n_f32(vmulq_f32(y, zt), 0.25f), vp_13li);
+
+        float32x4_t r = vaddq_f32(vaddq_f32(vmulq_n_f32(x,  3.2404542f), vmulq_n_f32(y, -1.5371385f)), vmulq_n_f32(z, -0.4985314f));
+        float32x4_t g = vaddq_f32(vaddq_f32(vmulq_n_f32(x, -0.9692660f), vmulq_n_f32(y,  1.8760108f)), vmulq_n_f32(z,  0.0415560f));
+        float32x4_t b = vaddq_f32(vaddq_f32(vmulq_n_f32(x,  0.0556434f), vmulq_n_f32(y, -0.2040259f)), vmulq_n_f32(z,  1.0572252f));
+
+        r = vmulq_f32(vminq_f32(vmaxq_f32(r, zero), one), scale);
+        g = vmulq_f32(vminq_f32(vmaxq_f32(g, zero), one), scale);
+        b = vmulq_f32(vminq_f32(vmaxq_f32(b, zero), one), scale);
+        const float32x4_t a = vmulq_f32(vminq_f32(vmaxq_f32(W, zero), one), scale);
+
+        uint16x4x4_t rgba_;
+        rgba_.val[0] = vmovn_u32(vcvtq_u32_f32(r));
+        rgba_.val[1] = vmovn_u32(vcvtq_u32_f32(g));
+        rgba_.val[2] = vmovn_u32(vcvtq_u32_f32(b));
+        rgba_.val[3] = vmovn_u32(vcvtq_u32_f32(a));
+        vst4_u16(&out[c].r, rgba_);
+    }
+    CIELUV2LED_scalar(in + c, out + c, n - c);
+}
+
+#endif  // #if defined(VEC4F_NEON)
+
+using CIELUV2LED_func = void (*)(const vec4 *in, rgba<uint16_t> *out, size_t n);
+
+static CIELUV2LED_func select_CIELUV2LED() {
+#if defined(COLOR_HAS_AVX2)
+    // Runs during static initialization, before the cpu model is set up on its own
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return CIELUV2LED_avx2;
+    }
+#endif  // #if defined(COLOR_HAS_AVX2)
+#if defined(COLOR_HAS_NEON)
+    return CIELUV2LED_neon;
+#endif  // #if defined(COLOR_HAS_NEON)
+    return CIELUV2LED_scalar;
+}
+
+static const CIELUV2LED_func CIELUV2LED_best = select_CIELUV2LED();
+
+void CIELUV2LED(const vec4 *in, rgba<uint16_t> *out, size_t n) {
+    CIELUV2LED_best(in, out, n);
+}
+
+void CIELUV2LED(const vec4f *in, rgba<uint16_t> *out, size_t n) {
+#if defined(VEC4F_SSE)
+    CIELUV2LED_sse(in, out, n);
+#elif defined(VEC4F_NEON)
+    CIELUV2LED_neon(in, out, n);
+#else  // #if defined(VEC4F_SSE)
+    CIELUV2LED_scalar(in, out, n);
+#endif  // #if defined(VEC4F_SSE)
+}
+
+}
@@ -2,6 +2,7 @@
 #define _COLOR_H_
 
 #include "./vec4.h"
+#include "./vec4f.h"
 
 #include <array>
 
@@ -101,9 +102,14 @@ namespace ledstickler {
         }
 
         constexpr vec4 sRGB2CIELUV(const rgba<T> &in) const  {
-            double r = sRGB2lRGB[in.r];
-            double g = sRGB2lRGB[in.g];
-            double b = sRGB2lRGB[in.b];
+            return LED2CIELUV(vec4(sRGB2lRGB[in.r], sRGB2lRGB[in.g], sRGB2lRGB[in.b]));
+        }
+
+        // Linear RGB (0..1) as sent to the LEDs, the inverse of CIELUV2LED.
+        static constexpr vec4 LED2CIELUV(const vec4 &in) {
+            double r = in.x;
+            double g = in.y;
+            double b = in.z;
 
             double X = 0.4124564 * r + 0.3575761 * g + 0.1804375 * b;
             double Y = 0.2126729 * r + 0.7151522 * g + 0.0721750 * b;
@@ -149,6 +155,15 @@ namespace ledstickler {
         std::array<double, colors_n> sRGB2lRGB;
     };
 
+    // Batch form of color_convert::CIELUV2LED producing clamped 16-bit RGB,
+    // alpha carries w. Uses AVX2 or NEON where available, results match
+    // the scalar reference to within one LSB.
+    void CIELUV2LED(const vec4 *in, rgba<uint16_t> *out, size_t n);
+
+    // Single precision variant for the render path (SSE2 or NEON, 4 points
+    // at a time), within a few LSB of the double precision reference.
+    void CIELUV2LED(const vec4f *in, rgba<uint16_t> *out, size_t n);
+
     constexpr vec4 srgb8_stop(const rgba<uint8_t> &color, double stop) {
         return vec4(color_convert<uint8_t>().sRGB2CIELUV(color), stop);
     }
@@ -0,0 +1,43 @@
+#include "./effect.h"
+
+namespace ledstickler {
+
+effect_registry::effect_registry() {
+    add_blender<blend_add>("add");
+    add_blender<blend_override>("override");
+}
+
+effect_registry &effect_registry::instance() {
+    static effect_registry registry;
+    return registry;
+}
+
+const effect *effect_registry::find_effect(const std::string &name) const {
+    auto it = effects.find(name);
+    return it != effects.end() ? it->second : nullptr;
+}
+
+const blender *effect_registry::find_blender(const std::string &name) const {
+    auto it = blenders.find(name);
+    return it != blenders.end() ? it->second : nullptr;
+}
+
+std::string effect_registry::effect_name(const effect *e) const {
+    for (const auto &item : effects) {
+        if (item.second == e) {
+            return item.first;
+        }
+    }
+    return std::string();
+}
+
+std::string effect_registry::blender_name(const blender *b) const {
+    for (const auto &item : blenders) {
+        if (item.second == b) {
+            return item.first;
+        }
+    }
+    return std::string();
+}
+
+}
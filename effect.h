@@ -0,0 +1,151 @@
+#ifndef _EFFECT_H_
+#define _EFFECT_H_
+
+#include "./vec4.h"
+#include "./vec4f.h"
+#include "./fixture.h"
+#include "./scene.h"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace ledstickler {
+
+    struct span;
+
+    // A run of points from one fixture, evaluated in a single call. The
+    // normalized coordinates come precomputed from the scene, level 0 being
+    // relative to the owning fixture, higher levels to its ancestors.
+    struct point_batch {
+        const scene &s;
+        const std::vector<const fixture *> &fixtures_stack;
+        size_t first;
+        size_t count;
+
+        const vec4 *positions() const { return &s.positions[first]; }
+        const vec4f *unit(size_t level = 0) const { return s.unit(level) + first; }
+        const vec4f *norm(size_t level = 0) const { return s.norm(level) + first; }
+        const vec4f *norm_uniform(size_t level = 0) const { return s.norm_uniform(level) + first; }
+    };
+
+    // A single point as seen by a per point effect.
+    struct point_ref {
+        const vec4 &pos;
+        const vec4f &unit;
+        const vec4f &norm;
+        const vec4f &norm_uniform;
+        const std::vector<const fixture *> &fixtures_stack;
+    };
+
+    // Type erased effect, invoked once per active span and batch.
+    class effect {
+    public:
+        virtual ~effect() = default;
+        virtual void evaluate(const span &s, const point_batch &points, vec4f *out, double time) const = 0;
+
+        // Called once per frame for every active span on the render thread,
+        // before any evaluate() of that frame. Effects fed from outside latch
+        // their input here so all batches of a frame see the same state.
+        virtual void prepare(const span &, double) const { }
+    };
+
+    // Type erased blend mode: btm[i] = blend(top[i], btm[i]) for a batch.
+    class blender {
+    public:
+        virtual ~blender() = default;
+        virtual void blend(const vec4f *top, vec4f *btm, size_t count, float in_f, float out_f) const = 0;
+    };
+
+    template<typename T, typename = void> struct has_batch_evaluate : std::false_type { };
+    template<typename T> struct has_batch_evaluate<T, std::void_t<decltype(
+        T::evaluate(std::declval<const span &>(), std::declval<const point_batch &>(), std::declval<vec4f *>(), 0.0))>> : std::true_type { };
+
+    // Effects are plain types. Either they provide a batch entry point
+    //   static void evaluate(const span &, const point_batch &, vec4f *out, double time);
+    // or a per point one
+    //   static vec4f calc(const span &, const point_ref &p, double time);
+    // which gets inlined into a loop instantiated for that type.
+    template<typename T> class effect_impl final : public effect {
+    public:
+        void evaluate(const span &s, const point_batch &points, vec4f *out, double time) const override {
+            if constexpr (has_batch_evaluate<T>::value) {
+                T::evaluate(s, points, out, time);
+            } else {
+                const vec4 *pos = points.positions();
+                const vec4f *unit = points.unit();
+                const vec4f *norm = points.norm();
+                const vec4f *norm_uniform = points.norm_uniform();
+                for (size_t c = 0; c < points.count; c++) {
+                    out[c] = T::calc(s, point_ref { pos[c], unit[c], norm[c], norm_uniform[c], points.fixtures_stack }, time);
+                }
+            }
+        }
+    };
+
+    // Blend modes provide static vec4f blend(const vec4f &top, const vec4f &btm, float in_f, float out_f);
+    template<typename T> class blender_impl final : public blender {
+    public:
+        void blend(const vec4f *top, vec4f *btm, size_t count, float in_f, float out_f) const override {
+            for (size_t c = 0; c < count; c++) {
+                btm[c] = T::blend(top[c], btm[c], in_f, out_f);
+            }
+        }
+    };
+
+    template<typename T> const effect *effect_of() {
+        static const effect_impl<T> e;
+        return &e;
+    }
+
+    template<typename T> const blender *blender_of() {
+        static const blender_impl<T> b;
+        return &b;
+    }
+
+    struct blend_add {
+        static vec4f blend(const vec4f &top, const vec4f &btm, float in_f, float out_f) {
+            return btm + top * in_f * out_f;
+        }
+    };
+
+    // Replaces what is below by top, weighted by top.w. Effects mark the
+    // points they cover with w = 1 and leave the rest untouched.
+    struct blend_override {
+        static vec4f blend(const vec4f &top, const vec4f &btm, float in_f, float out_f) {
+            return vec4f::lerp(btm, top, top.w * in_f * out_f);
+        }
+    };
+
+    // Name -> effect/blend mode lookup, so shows can refer to them by name.
+    class effect_registry {
+    public:
+        static effect_registry &instance();
+
+        template<typename T> const effect *add_effect(const std::string &name) {
+            return effects[name] = effect_of<T>();
+        }
+
+        template<typename T> const blender *add_blender(const std::string &name) {
+            return blenders[name] = blender_of<T>();
+        }
+
+        const effect *find_effect(const std::string &name) const;
+        const blender *find_blender(const std::string &name) const;
+
+        // Reverse lookups, empty if e or b was never registered.
+        std::string effect_name(const effect *e) const;
+        std::string blender_name(const blender *b) const;
+
+    private:
+        effect_registry();
+
+        std::unordered_map<std::string, const effect *> effects;
+        std::unordered_map<std::string, const blender *> blenders;
+    };
+
+}
+
+#endif  // #ifndef _EFFECT_H_
@@ -25,6 +25,28 @@ namespace ledstickler {
         }
     };
     
+    // Channel layout of one pixel on the wire. 16 bit channels are big endian.
+    enum class pixel_format : uint8_t {
+        rgb16,
+        rgb8,
+        grb16,
+        grb8,
+        rgbw16,
+        rgbw8
+    };
+
+    constexpr size_t pixel_format_size(pixel_format format) {
+        switch (format) {
+            case pixel_format::rgb16:  return 6;
+            case pixel_format::rgb8:   return 3;
+            case pixel_format::grb16:  return 6;
+            case pixel_format::grb8:   return 3;
+            case pixel_format::rgbw16: return 8;
+            case pixel_format::rgbw8:  return 4;
+        }
+        return 0;
+    }
+
     struct fixture {
         fixture() = default;
 
@@ -49,6 +71,10 @@ namespace ledstickler {
             universes.push_back(universe);
         }
 
+        void push(pixel_format f) {
+            format = f;
+        }
+
         void push(const fixture &f) {
             bounds.add(f.bounds);
             fixtures.push_back(f);
@@ -57,35 +83,7 @@ namespace ledstickler {
     
         void push(const vec4 &p) {
             bounds.add(p);
-            points.push_back({0,p});
-        }
-
-        void walk_points(std::function<vec4 (const std::vector<const fixture *> &fixture_stack, const vec4& point)> func) {
-            std::vector<fixture *> fixtures_stack;
-            std::vector<const fixture *> fixtures_stack_const;
-            fixtures_stack.insert(fixtures_stack.cbegin(), this);
-            fixtures_stack_const.insert(fixtures_stack_const.cbegin(), this);
-            walk_points(func, fixtures_stack, fixtures_stack_const);
-            fixtures_stack.erase(fixtures_stack.cbegin());
-            fixtures_stack_const.erase(fixtures_stack_const.cbegin());
-        }
-
-        void walk_points(std::function<vec4 (const std::vector<const fixture *> &fixture_stack, const vec4& point)> func, 
-            std::vector<fixture *> &fixtures_stack,
-            std::vector<const fixture *> &fixtures_stack_const) {
-            if (fixtures_stack.size() == 0 || fixtures_stack.front() == nullptr) {
-                return;
-            }
-            for (auto& item : fixtures_stack.front()->fixtures) {
-                fixtures_stack.insert(fixtures_stack.cbegin(), &item);
-                fixtures_stack_const.insert(fixtures_stack_const.cbegin(), &item);
-                walk_points(func, fixtures_stack, fixtures_stack_const);
-                fixtures_stack.erase(fixtures_stack.cbegin());
-                fixtures_stack_const.erase(fixtures_stack_const.cbegin());
-            }
-            for (auto& item : fixtures_stack.front()->points) {
-                item.first = func(fixtures_stack_const, item.second);
-            }
+            points.push_back(p);
         }
 
         void walk_fixtures(std::function<void (const std::vector<const fixture *> &fixture_stack)> func) const {
@@ -114,8 +112,9 @@ namespace ledstickler {
         ipv4 address;
         vec4 properties;
         std::vector<uint16_t> universes;
+        pixel_format format = pixel_format::rgb16;
         std::vector<fixture> fixtures;
-        std::vector<std::pair<vec4, vec4>> points;
+        std::vector<vec4> points;
     };
 
 }
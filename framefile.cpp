@@ -0,0 +1,217 @@
+#include "./framefile.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else  // #if defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // #if defined(_WIN32)
+
+namespace ledstickler {
+
+static size_t align_up(size_t v, size_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+frame_writer::~frame_writer() {
+    close();
+}
+
+bool frame_writer::open(const std::string &path, frame_format format, uint64_t frame_time_us, const scene &s, const artnet_output &output) {
+    close();
+
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    buffer.resize(size_t(1) << 20);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    head = frame_file_header();
+    head.format = format;
+    head.frame_time_us = frame_time_us;
+
+    std::vector<frame_file_universe> table;
+    size_t payload = 0;
+    switch (format) {
+        case frame_format::leds:
+            head.element_count = uint32_t(s.size());
+            payload = s.size() * sizeof(rgba<uint16_t>);
+            break;
+        case frame_format::artnet:
+            head.element_count = uint32_t(output.universes.size());
+            for (const auto &u : output.universes) {
+                frame_file_universe entry;
+                entry.address = u.f->address.addr();
+                entry.universe = u.universe;
+                entry.length = uint16_t(u.size - artnet_dmx_header_size);
+                entry.offset = sizeof(double) + payload;
+                payload += entry.length;
+                table.push_back(entry);
+            }
+            break;
+    }
+    head.frame_size = align_up(sizeof(double) + payload, frame_record_alignment);
+    head.data_offset = align_up(sizeof(frame_file_header) + table.size() * sizeof(frame_file_universe), frame_file_alignment);
+    record.assign(head.frame_size, 0);
+
+    std::vector<uint8_t> preamble(head.data_offset, 0);
+    memcpy(preamble.data(), &head, sizeof(head));
+    if (table.size()) {
+        memcpy(preamble.data() + sizeof(head), table.data(), table.size() * sizeof(frame_file_universe));
+    }
+    if (fwrite(preamble.data(), 1, preamble.size(), file) != preamble.size()) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool frame_writer::write(double time, const scene &s, const artnet_output &output) {
+    if (!file) {
+        return false;
+    }
+    memcpy(record.data(), &time, sizeof(time));
+    uint8_t *dst = record.data() + sizeof(double);
+    switch (head.format) {
+        case frame_format::leds:
+            memcpy(dst, s.leds.data(), s.leds.size() * sizeof(rgba<uint16_t>));
+            break;
+        case frame_format::artnet:
+            for (const auto &u : output.universes) {
+                const size_t len = u.size - artnet_dmx_header_size;
+                memcpy(dst, u.packet.data() + artnet_dmx_header_size, len);
+                dst += len;
+            }
+            break;
+    }
+    if (fwrite(record.data(), 1, record.size(), file) != record.size()) {
+        return false;
+    }
+    head.frame_count++;
+    return true;
+}
+
+bool frame_writer::close() {
+    if (!file) {
+        return true;
+    }
+    bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&head, 1, sizeof(head), file) == sizeof(head);
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
+
+frame_file::~frame_file() {
+    close();
+}
+
+bool frame_file::open(const std::string &path) {
+    close();
+
+#if defined(_WIN32)
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(f, &size);
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+    length = size_t(size.QuadPart);
+    base = static_cast<const uint8_t *>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+#else  // #if defined(_WIN32)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    length = size_t(st.st_size);
+    void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        length = 0;
+        return false;
+    }
+    // Playback walks the records front to back
+    madvise(p, length, MADV_SEQUENTIAL);
+    base = static_cast<const uint8_t *>(p);
+#endif  // #if defined(_WIN32)
+
+    static const frame_file_header expected;
+    const bool valid = base &&
+        length >= sizeof(frame_file_header) &&
+        memcmp(header().magic, expected.magic, sizeof(expected.magic)) == 0 &&
+        header().version == expected.version &&
+        header().frame_size >= sizeof(double) &&
+        // Divide rather than multiply, a malformed header must not wrap around
+        header().data_offset <= length &&
+        header().frame_count <= (length - header().data_offset) / header().frame_size;
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    // Every element has to lie inside a record
+    const frame_file_header &h = header();
+    bool elements = true;
+    switch (h.format) {
+        case frame_format::leds:
+            elements = h.element_count <= (h.frame_size - sizeof(double)) / sizeof(rgba<uint16_t>);
+            break;
+        case frame_format::artnet:
+            elements = h.data_offset >= sizeof(frame_file_header) &&
+                h.element_count <= (h.data_offset - sizeof(frame_file_header)) / sizeof(frame_file_universe);
+            for (size_t c = 0; elements && c < h.element_count; c++) {
+                const frame_file_universe &u = universes()[c];
+                elements = u.offset <= h.frame_size && u.length <= h.frame_size - u.offset && u.length <= artnet_dmx_len;
+            }
+            break;
+        default:
+            elements = false;
+            break;
+    }
+    if (!elements) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void frame_file::close() {
+#if defined(_WIN32)
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    mapping = nullptr;
+    file = nullptr;
+#else  // #if defined(_WIN32)
+    if (base) {
+        munmap(const_cast<uint8_t *>(base), length);
+    }
+#endif  // #if defined(_WIN32)
+    base = nullptr;
+    length = 0;
+}
+
+}
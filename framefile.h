@@ -0,0 +1,109 @@
+#ifndef _FRAMEFILE_H_
+#define _FRAMEFILE_H_
+
+#include "./scene.h"
+#include "./artnet.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ledstickler {
+
+    // What a frame file stores per frame.
+    enum class frame_format : uint32_t {
+        leds = 0,   // rgba<uint16_t> per point in scene order
+        artnet = 1  // ArtDmx payload per universe in artnet_output order
+    };
+
+    // Frame files are little endian and laid out to be memory mapped: a
+    // header, a table of elements, then fixed size frame records starting
+    // at data_offset. Each record is a double show time followed by the
+    // payload, padded to frame_size.
+    struct frame_file_header {
+        char magic[8] = { 'L', 'S', 'F', 'R', 'A', 'M', 'E', 'S' };
+        uint32_t version = 1;
+        frame_format format = frame_format::leds;
+        uint64_t frame_time_us = 0;
+        uint64_t frame_count = 0;
+        uint64_t frame_size = 0;
+        uint64_t data_offset = 0;
+        uint32_t element_count = 0;  // points or universes
+        uint32_t reserved = 0;
+    };
+
+    // Element table entry for frame_format::artnet. offset is relative to
+    // the start of a frame record.
+    struct frame_file_universe {
+        uint32_t address = 0;
+        uint16_t universe = 0;
+        uint16_t length = 0;
+        uint64_t offset = 0;
+    };
+
+    static_assert(sizeof(frame_file_header) == 56, "frame_file_header layout");
+    static_assert(sizeof(frame_file_universe) == 16, "frame_file_universe layout");
+
+    constexpr size_t frame_file_alignment = 4096;
+    constexpr size_t frame_record_alignment = 64;
+
+    // Streams frames to disk through a large stdio buffer. The header is
+    // written up front and the frame count patched in by close().
+    class frame_writer {
+    public:
+        frame_writer() = default;
+        ~frame_writer();
+
+        frame_writer(const frame_writer &) = delete;
+        frame_writer &operator=(const frame_writer &) = delete;
+
+        // Returns false if path can not be created.
+        bool open(const std::string &path, frame_format format, uint64_t frame_time_us, const scene &s, const artnet_output &output);
+        bool write(double time, const scene &s, const artnet_output &output);
+        bool close();
+
+        const frame_file_header &header() const { return head; }
+
+    private:
+        FILE *file = nullptr;
+        frame_file_header head;
+        std::vector<uint8_t> record;
+        std::vector<char> buffer;
+    };
+
+    // Read only memory mapping of a frame file. Records are used in place,
+    // nothing is copied or parsed per frame.
+    class frame_file {
+    public:
+        frame_file() = default;
+        ~frame_file();
+
+        frame_file(const frame_file &) = delete;
+        frame_file &operator=(const frame_file &) = delete;
+
+        // Returns false if path is missing, truncated or not a frame file.
+        bool open(const std::string &path);
+        void close();
+
+        const frame_file_header &header() const { return *reinterpret_cast<const frame_file_header *>(base); }
+        const frame_file_universe *universes() const { return reinterpret_cast<const frame_file_universe *>(base + sizeof(frame_file_header)); }
+        size_t frame_count() const { return size_t(header().frame_count); }
+
+        const uint8_t *record(size_t index) const { return base + header().data_offset + index * header().frame_size; }
+        double time(size_t index) const { double t; memcpy(&t, record(index), sizeof(t)); return t; }
+        const uint8_t *payload(size_t index) const { return record(index) + sizeof(double); }
+
+    private:
+        const uint8_t *base = nullptr;
+        size_t length = 0;
+#if defined(_WIN32)
+        void *file = nullptr;
+        void *mapping = nullptr;
+#endif  // #if defined(_WIN32)
+    };
+
+}
+
+#endif  // #ifndef _FRAMEFILE_H_
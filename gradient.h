@@ -4,12 +4,18 @@
 #include <array>
 
 #include "./vec4.h"
+#include "./vec4f.h"
 #include "./color.h"
 
 namespace ledstickler {
 
-    double ffrac(double v) { return v - std::floor(v); }
+    constexpr inline double ffrac(double v) { return v - math_prefix::floor(v); }
 
+    // Colors are kept in a single float table of 2^colors_2n entries, 4 KB
+    // for the default size. The batched overloads turn parameters into 16.16
+    // fixed point table positions four at a time and blend the two adjacent
+    // entries. The per point overloads are the scalar reference the batched
+    // ones are checked and benchmarked against.
     template<size_t colors_2n = 8> class gradient {
     public:
         constexpr gradient(const vec4 *stops, const size_t n) {
@@ -28,14 +34,14 @@ namespace ledstickler {
                 }
                 f -= a.w;
                 f /= b.w - a.w;
-                colors[c] = a.lerp(b,f);
+                colorsf[c] = vec4f(a.lerp(b,f));
             }
         }
 
         constexpr vec4 repeat(double i) const {
             i = ffrac(i);
             i *= colors_mul;
-            return vec4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], ffrac(i));
+            return vec4::lerp(color(static_cast<size_t>(i)), color(static_cast<size_t>(i)+1), ffrac(i));
         }
 
         constexpr vec4 reflect(double i) const {
@@ -48,25 +54,164 @@ namespace ledstickler {
             }
             i *= colors_mul;
             
-            return vec4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], ffrac(i));
+            return vec4::lerp(color(static_cast<size_t>(i)), color(static_cast<size_t>(i)+1), ffrac(i));
         }
         
         constexpr vec4 clamp(double i) const {
             if (i <= 0.0) {
-                return colors[0];
+                return color(0);
             }
             if (i >= 1.0) {
-                return colors[colors_n-1];
+                return color(colors_n-1);
             }
             i *= colors_mul;
-            return vec4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], ffrac(i));
+            return vec4::lerp(color(static_cast<size_t>(i)), color(static_cast<size_t>(i)+1), ffrac(i));
+        }
+
+        // Single precision lookups for the render path, same semantics as above.
+
+        vec4f repeat(float i) const {
+            i -= std::floor(i);
+            i *= colors_mulf;
+            return lookup(i);
+        }
+
+        vec4f reflect(float i) const {
+            i = std::fabs(i);
+            if ((static_cast<int32_t>(i) & 1) == 0) {
+                i -= std::floor(i);
+            } else {
+                i -= std::floor(i);
+                i = 1.0f - i;
+            }
+            i *= colors_mulf;
+            return lookup(i);
+        }
+
+        vec4f clamp(float i) const {
+            if (i <= 0.0f) {
+                return colorsf[0];
+            }
+            if (i >= 1.0f) {
+                return colorsf[colors_n-1];
+            }
+            i *= colors_mulf;
+            return lookup(i);
+        }
+
+        // Batched lookups, out[c] = repeat(in[c]) and so on.
+
+        void repeat(const float *in, vec4f *out, size_t count) const {
+            evaluate<mode::repeat>(in, out, count);
+        }
+
+        void reflect(const float *in, vec4f *out, size_t count) const {
+            evaluate<mode::reflect>(in, out, count);
+        }
+
+        void clamp(const float *in, vec4f *out, size_t count) const {
+            evaluate<mode::clamp>(in, out, count);
         }
 
     private:
+        enum class mode { repeat, reflect, clamp };
+
+        constexpr vec4 color(size_t idx) const {
+            return vec4(colorsf[idx&colors_mask]);
+        }
+
+        vec4f lookup(float i) const {
+            const size_t idx = static_cast<size_t>(i);
+            return vec4f::lerp(colorsf[idx&colors_mask], colorsf[(idx+1)&colors_mask], i - static_cast<float>(idx));
+        }
+
+        vec4f lookup_fixed(int32_t pos) const {
+            const size_t idx = static_cast<size_t>(pos >> 16);
+            return vec4f::lerp(colorsf[idx&colors_mask], colorsf[(idx+1)&colors_mask], static_cast<float>(pos & 0xFFFF) * (1.0f / 65536.0f));
+        }
+
+        // Maps a parameter to its 16.16 table position.
+        template<mode M> static int32_t position(float i) {
+            if constexpr (M == mode::repeat) {
+                i -= std::floor(i);
+            } else if constexpr (M == mode::reflect) {
+                i = std::fabs(i);
+                const float f = std::floor(i);
+                i = (static_cast<int32_t>(f) & 1) ? 1.0f - (i - f) : i - f;
+            } else {
+                i = std::min(std::max(i, 0.0f), 1.0f);
+            }
+            return static_cast<int32_t>(i * colors_fixed);
+        }
+
+        template<mode M> void evaluate(const float *in, vec4f *out, size_t count) const {
+            size_t c = 0;
+#if defined(VEC4F_SSE)
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 scale = _mm_set1_ps(colors_fixed);
+            for (; c + 4 <= count; c += 4) {
+                __m128 i = _mm_loadu_ps(in + c);
+                if constexpr (M == mode::clamp) {
+                    i = _mm_min_ps(_mm_max_ps(i, _mm_setzero_ps()), one);
+                } else {
+                    if constexpr (M == mode::reflect) {
+                        i = _mm_andnot_ps(_mm_set1_ps(-0.0f), i);
+                    }
+                    // floor from truncation, parameters stay well inside int32 range
+                    const __m128i t = _mm_cvttps_epi32(i);
+                    __m128 f = _mm_cvtepi32_ps(t);
+                    const __m128 adjust = _mm_and_ps(_mm_cmpgt_ps(f, i), one);
+                    f = _mm_sub_ps(f, adjust);
+                    i = _mm_sub_ps(i, f);
+                    if constexpr (M == mode::reflect) {
+                        const __m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(t, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+                        i = _mm_or_ps(_mm_and_ps(odd, _mm_sub_ps(one, i)), _mm_andnot_ps(odd, i));
+                    }
+                }
+                alignas(16) int32_t pos[4];
+                _mm_store_si128(reinterpret_cast<__m128i *>(pos), _mm_cvttps_epi32(_mm_mul_ps(i, scale)));
+                out[c+0] = lookup_fixed(pos[0]);
+                out[c+1] = lookup_fixed(pos[1]);
+                out[c+2] = lookup_fixed(pos[2]);
+                out[c+3] = lookup_fixed(pos[3]);
+            }
+#elif defined(VEC4F_NEON)
+            const float32x4_t one = vdupq_n_f32(1.0f);
+            for (; c + 4 <= count; c += 4) {
+                float32x4_t i = vld1q_f32(in + c);
+                if constexpr (M == mode::clamp) {
+                    i = vminq_f32(vmaxq_f32(i, vdupq_n_f32(0.0f)), one);
+                } else {
+                    if constexpr (M == mode::reflect) {
+                        i = vabsq_f32(i);
+                    }
+                    const float32x4_t f = vrndmq_f32(i);
+                    const int32x4_t t = vcvtq_s32_f32(f);
+                    i = vsubq_f32(i, f);
+                    if constexpr (M == mode::reflect) {
+                        const uint32x4_t odd = vtstq_s32(t, vdupq_n_s32(1));
+                        i = vbslq_f32(odd, vsubq_f32(one, i), i);
+                    }
+                }
+                int32_t pos[4];
+                vst1q_s32(pos, vcvtq_s32_f32(vmulq_n_f32(i, colors_fixed)));
+                out[c+0] = lookup_fixed(pos[0]);
+                out[c+1] = lookup_fixed(pos[1]);
+                out[c+2] = lookup_fixed(pos[2]);
+                out[c+3] = lookup_fixed(pos[3]);
+            }
+#endif  // #if defined(VEC4F_SSE)
+            for (; c < count; c++) {
+                out[c] = lookup_fixed(position<M>(in[c]));
+            }
+        }
+
         static constexpr size_t colors_n = 1UL << colors_2n;
         static constexpr double colors_mul = static_cast<double>(colors_n - 1);
+        static constexpr float colors_mulf = static_cast<float>(colors_n - 1);
+        static constexpr float colors_fixed = colors_mulf * 65536.0f;
         static constexpr size_t colors_mask = colors_n - 1;
-        std::array<vec4, colors_n> colors;
+        std::array<vec4f, colors_n> colorsf;
     };
 
 }
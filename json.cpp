@@ -0,0 +1,279 @@
+#include "./json.h"
+
+#include <cstdlib>
+
+namespace ledstickler {
+
+const json_value *json_value::find(const std::string &key) const {
+    if (kind != object) {
+        return nullptr;
+    }
+    for (const auto &m : members) {
+        if (m.first == key) {
+            return &m.second;
+        }
+    }
+    return nullptr;
+}
+
+double json_value::number_or(const std::string &key, double def) const {
+    const json_value *v = find(key);
+    return v && v->kind == number ? v->n : def;
+}
+
+std::string json_value::string_or(const std::string &key, const std::string &def) const {
+    const json_value *v = find(key);
+    return v && v->kind == string ? v->s : def;
+}
+
+namespace {
+
+class json_parser {
+public:
+    json_parser(const std::string &text, std::string &_error) :
+        p(text.c_str()),
+        end(text.c_str() + text.size()),
+        error(_error) {
+    }
+
+    bool document(json_value &out) {
+        if (!value(out, 0)) {
+            return false;
+        }
+        skip();
+        return p == end || fail("trailing characters");
+    }
+
+private:
+    static constexpr int max_depth = 256;
+
+    bool fail(const char *what) {
+        error = std::string(what) + " at line " + std::to_string(line);
+        return false;
+    }
+
+    void skip() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            line += *p == '\n' ? 1 : 0;
+            p++;
+        }
+    }
+
+    bool literal(const char *word) {
+        const char *q = p;
+        for (; *word; word++, q++) {
+            if (q >= end || *q != *word) {
+                return false;
+            }
+        }
+        p = q;
+        return true;
+    }
+
+    bool value(json_value &out, int depth) {
+        if (depth > max_depth) {
+            return fail("nesting too deep");
+        }
+        skip();
+        if (p >= end) {
+            return fail("unexpected end of input");
+        }
+        switch (*p) {
+            case '{':
+                return object(out, depth);
+            case '[':
+                return array(out, depth);
+            case '"':
+                out.kind = json_value::string;
+                return string(out.s);
+            case 't':
+            case 'f':
+                out.kind = json_value::boolean;
+                out.b = *p == 't';
+                return literal(out.b ? "true" : "false") || fail("invalid literal");
+            case 'n':
+                out.kind = json_value::null;
+                return literal("null") || fail("invalid literal");
+            default:
+                return number(out);
+        }
+    }
+
+    bool number(json_value &out) {
+        // strtod stops at the terminating NUL of the backing string at the latest
+        char *q = nullptr;
+        out.n = strtod(p, &q);
+        if (q == p) {
+            return fail("unexpected character");
+        }
+        out.kind = json_value::number;
+        p = q;
+        return true;
+    }
+
+    static void utf8(std::string &s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += char(cp);
+        } else if (cp < 0x800) {
+            s += char(0xC0 | (cp >> 6));
+            s += char(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += char(0xE0 | (cp >> 12));
+            s += char(0x80 | ((cp >> 6) & 0x3F));
+            s += char(0x80 | (cp & 0x3F));
+        } else {
+            s += char(0xF0 | (cp >> 18));
+            s += char(0x80 | ((cp >> 12) & 0x3F));
+            s += char(0x80 | ((cp >> 6) & 0x3F));
+            s += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool hex4(uint32_t &cp) {
+        if (end - p < 4) {
+            return fail("truncated escape");
+        }
+        cp = 0;
+        for (int c = 0; c < 4; c++, p++) {
+            const char h = *p;
+            cp <<= 4;
+            if (h >= '0' && h <= '9') {
+                cp |= uint32_t(h - '0');
+            } else if (h >= 'a' && h <= 'f') {
+                cp |= uint32_t(h - 'a' + 10);
+            } else if (h >= 'A' && h <= 'F') {
+                cp |= uint32_t(h - 'A' + 10);
+            } else {
+                return fail("invalid escape");
+            }
+        }
+        return true;
+    }
+
+    bool string(std::string &out) {
+        p++;
+        out.clear();
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                line += *p == '\n' ? 1 : 0;
+                out += *p++;
+                continue;
+            }
+            if (++p >= end) {
+                break;
+            }
+            const char e = *p++;
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (!hex4(cp)) {
+                        return false;
+                    }
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        uint32_t lo = 0;
+                        if (!hex4(lo)) {
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    utf8(out, cp);
+                } break;
+                default:
+                    return fail("invalid escape");
+            }
+        }
+        if (p >= end) {
+            return fail("unterminated string");
+        }
+        p++;
+        return true;
+    }
+
+    bool array(json_value &out, int depth) {
+        p++;
+        out.kind = json_value::array;
+        skip();
+        if (p < end && *p == ']') {
+            p++;
+            return true;
+        }
+        for (;;) {
+            out.items.emplace_back();
+            if (!value(out.items.back(), depth + 1)) {
+                return false;
+            }
+            skip();
+            if (p < end && *p == ',') {
+                p++;
+                continue;
+            }
+            if (p < end && *p == ']') {
+                p++;
+                return true;
+            }
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    bool object(json_value &out, int depth) {
+        p++;
+        out.kind = json_value::object;
+        skip();
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        for (;;) {
+            skip();
+            if (p >= end || *p != '"') {
+                return fail("expected member name");
+            }
+            out.members.emplace_back();
+            if (!string(out.members.back().first)) {
+                return false;
+            }
+            skip();
+            if (p >= end || *p != ':') {
+                return fail("expected ':'");
+            }
+            p++;
+            if (!value(out.members.back().second, depth + 1)) {
+                return false;
+            }
+            skip();
+            if (p < end && *p == ',') {
+                p++;
+                continue;
+            }
+            if (p < end && *p == '}') {
+                p++;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    const char *p;
+    const char *end;
+    std::string &error;
+    size_t line = 1;
+};
+
+}
+
+bool json_parse(const std::string &text, json_value &out, std::string &error) {
+    out = json_value();
+    json_parser parser(text, error);
+    return parser.document(out);
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef _JSON_H_
+#define _JSON_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ledstickler {
+
+    // Minimal JSON document tree, enough for show files and control
+    // messages. Objects keep their keys in file order.
+    struct json_value {
+        enum kind_t : uint8_t {
+            null,
+            boolean,
+            number,
+            string,
+            array,
+            object
+        };
+
+        kind_t kind = null;
+        bool b = false;
+        double n = 0.0;
+        std::string s;
+        std::vector<json_value> items;
+        std::vector<std::pair<std::string, json_value>> members;
+
+        // Member lookup, nullptr if this is not an object or key is missing.
+        const json_value *find(const std::string &key) const;
+
+        double number_or(const std::string &key, double def) const;
+        std::string string_or(const std::string &key, const std::string &def) const;
+    };
+
+    // Parses text into out. On failure returns false and describes the first
+    // problem with its line number in error.
+    bool json_parse(const std::string &text, json_value &out, std::string &error);
+
+}
+
+#endif  // #ifndef _JSON_H_
@@ -0,0 +1,167 @@
+#include "./live.h"
+#include "./color.h"
+#include "./metrics.h"
+#include "./receiver.h"
+#include "./snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace ledstickler {
+
+// Latest DMX of every universe in the layout, by slot. version counts the
+// packets seen for a slot so a buffer only copies slots that changed.
+struct dmx_frame {
+    std::vector<uint8_t> data;
+    std::vector<uint16_t> length;
+    std::vector<uint64_t> time_ns;
+    std::vector<uint64_t> version;
+
+    void resize(size_t slots) {
+        data.assign(slots * artnet_dmx_len, 0);
+        length.assign(slots, 0);
+        time_ns.assign(slots, 0);
+        version.assign(slots, 0);
+    }
+};
+
+struct live_layer::impl {
+    explicit impl(const scene &s) : layout(s) {
+        latest.resize(layout.universes.size());
+        for (dmx_frame &f : frames.all()) {
+            f.resize(layout.universes.size());
+        }
+        active.assign(layout.universes.size(), 0);
+    }
+
+    // Receive thread
+    void receive_loop();
+    void publish();
+
+    const artnet_layout layout;
+    uint64_t timeout_ns = 0;
+
+    udp_receiver receiver;
+    std::thread thread;
+    std::atomic<bool> stop { false };
+
+    dmx_frame latest;
+    bool changed = false; // latest holds data not published yet
+    uint64_t last_sync_ns = 0;
+    snapshot_buffer<dmx_frame> frames;
+
+    // Render thread, set by prepare()
+    std::vector<uint8_t> active;
+};
+
+// Art-Net nodes fall back to showing data as it arrives when ArtSync stops
+static constexpr uint64_t sync_timeout_ns = 4'000'000'000;
+
+void live_layer::impl::publish() {
+    dmx_frame &back = frames.back();
+    for (size_t slot = 0; slot < latest.version.size(); slot++) {
+        if (back.version[slot] == latest.version[slot]) {
+            continue;
+        }
+        memcpy(&back.data[slot * artnet_dmx_len], &latest.data[slot * artnet_dmx_len], latest.length[slot]);
+        back.length[slot] = latest.length[slot];
+        back.time_ns[slot] = latest.time_ns[slot];
+        back.version[slot] = latest.version[slot];
+    }
+    frames.publish();
+    changed = false;
+}
+
+void live_layer::impl::receive_loop() {
+    while (!stop.load(std::memory_order_relaxed)) {
+        const received_packet *packets = nullptr;
+        const size_t count = receiver.receive(packets, 100);
+        if (!count) {
+            continue;
+        }
+        for (size_t c = 0; c < count; c++) {
+            const received_packet &packet = packets[c];
+            const uint16_t opcode = artnet_opcode(packet.data, packet.size);
+            if (opcode == artnet_op_sync) {
+                last_sync_ns = packet.time_ns;
+                // A burst and its ArtSync can arrive in separate receive() calls
+                if (changed) {
+                    publish();
+                }
+                continue;
+            }
+            uint16_t universe = 0;
+            const uint8_t *dmx = nullptr;
+            size_t length = 0;
+            if (opcode != artnet_op_dmx || !artnet_parse_dmx(packet.data, packet.size, universe, dmx, length)) {
+                continue;
+            }
+            const uint32_t slot = layout.slot(universe);
+            if (slot == artnet_layout::no_slot) {
+                continue;
+            }
+            length = std::min(length, artnet_dmx_len);
+            memcpy(&latest.data[slot * artnet_dmx_len], dmx, length);
+            latest.length[slot] = uint16_t(length);
+            latest.time_ns[slot] = packet.time_ns;
+            latest.version[slot]++;
+            changed = true;
+        }
+        // Without a recent ArtSync every burst is as complete as it gets
+        if (changed && (!last_sync_ns || metrics::now() - last_sync_ns > sync_timeout_ns)) {
+            publish();
+        }
+    }
+}
+
+live_layer::live_layer(const scene &s) : p(std::make_unique<impl>(s)) {
+}
+
+live_layer::~live_layer() {
+    p->stop = true;
+    if (p->thread.joinable()) {
+        p->thread.join();
+    }
+}
+
+bool live_layer::start(const live_options &options) {
+    if (p->thread.joinable() || !p->receiver.open(options.port)) {
+        return false;
+    }
+    p->timeout_ns = uint64_t(std::max(options.timeout, 0.0) * 1e9);
+    p->thread = std::thread([this] { p->receive_loop(); });
+    return true;
+}
+
+size_t live_layer::ambiguous_universes() const {
+    return p->layout.ambiguous;
+}
+
+void live_layer::prepare(const span &, double) const {
+    p->frames.fetch();
+    const dmx_frame &f = p->frames.front();
+    const uint64_t now = metrics::now();
+    for (size_t slot = 0; slot < p->active.size(); slot++) {
+        p->active[slot] = f.length[slot] && now - f.time_ns[slot] < p->timeout_ns;
+    }
+}
+
+void live_layer::evaluate(const span &, const point_batch &points, vec4f *out, double) const {
+    const dmx_frame &f = p->frames.front();
+    for (size_t c = 0; c < points.count; c++) {
+        const artnet_layout::point &src = p->layout.points[points.first + c];
+        out[c] = vec4f();
+        if (src.slot == artnet_layout::no_slot || !p->active[src.slot] ||
+            src.offset + pixel_format_size(src.format) > f.length[src.slot]) {
+            continue;
+        }
+        const rgba<uint16_t> col = artnet_read_pixel(&f.data[src.slot * artnet_dmx_len + src.offset], src.format);
+        out[c] = vec4f(color_convert<uint8_t>::LED2CIELUV(vec4(double(col.r), double(col.g), double(col.b)) * (1.0 / 65535.0)));
+        out[c].w = 1.0f;
+    }
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef _LIVE_H_
+#define _LIVE_H_
+
+#include "./effect.h"
+#include "./artnet.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace ledstickler {
+
+    struct live_options {
+        uint16_t port = artnet_port;
+        double timeout = 4.0; // seconds without data before a universe lets go of its points
+    };
+
+    // Effect showing Art-Net received right now, e.g. from a lighting desk,
+    // so it can be layered into a timeline like any other span. Points are
+    // matched to universes the same way artnet_output packs them, by number
+    // only. Points of universes that are sending get w = 1, the rest,
+    // including universes several controllers share, are black with w = 0,
+    // which blend_override uses to only replace what the desk drives.
+    //
+    // A receive thread keeps the latest data of every universe and hands it
+    // to the renderer through a snapshot_buffer: after every ArtSync when the
+    // sender uses them, otherwise after every burst of packets. Neither side
+    // ever waits on the other. prepare() picks up the newest snapshot once
+    // per frame so every batch of a frame sees the same data.
+    class live_layer final : public effect {
+    public:
+        explicit live_layer(const scene &s);
+        ~live_layer() override;
+
+        live_layer(const live_layer &) = delete;
+        live_layer &operator=(const live_layer &) = delete;
+
+        // Starts listening. Returns false if the port can not be bound.
+        bool start(const live_options &options);
+
+        void prepare(const span &s, double time) const override;
+        void evaluate(const span &s, const point_batch &points, vec4f *out, double time) const override;
+
+        // Universe numbers used by several controllers, see artnet_layout.
+        size_t ambiguous_universes() const;
+
+    private:
+        struct impl;
+        std::unique_ptr<impl> p;
+    };
+
+}
+
+#endif  // #ifndef _LIVE_H_
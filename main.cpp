@@ -1,20 +1,36 @@
 #include <iostream>
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <cstdint>
 #include <functional>
 #include <cstring>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <memory>
 
 #include "./vec4.h"
+#include "./vec4f.h"
 #include "./matrix4x4.h"
 #include "./gradient.h"
 #include "./color.h"
 #include "./timeline.h"
 #include "./fixture.h"
 #include "./artnet.h"
+#include "./effect.h"
+#include "./scene.h"
+#include "./show.h"
+#include "./capture.h"
+#include "./live.h"
 
 namespace ledstickler {
 
 static uint64_t frame_time_us = 10'000;
+static overrun_policy overrun = overrun_policy::skip_ahead;
+static artnet_sync_mode sync_mode = artnet_sync_mode::per_controller;
+static ipv4 sync_broadcast = {192, 168, 1, 255};
 
 static constexpr vec4 gradient_rainbow_data[] = {
     srgb8_stop(rgba<uint8_t>{0xff,0x00,0x00}, 0.00),
@@ -49,54 +65,89 @@ static constexpr vec4 gradient_ramp_data[] = {
     srgb8_stop(rgba<uint8_t>{0x00,0x00,0x00}, 1.00)};
 static constexpr gradient gradient_ramp(gradient_ramp_data,2);
 
-static vec4 engineBlastoff(const span &, const std::vector<const fixture *> &fixtures, const vec4 &pos, double time) {
-    if (fixtures.size() == 0 || fixtures.front() == nullptr) {
-        return vec4();
+// Effects build their gradient parameters for a whole batch of points and
+// look them up in one call. Batches never exceed scene_chunk_size points.
+
+struct engineBlastoff {
+    static void evaluate(const span &, const point_batch &points, vec4f *out, double time) {
+        std::array<float, scene_chunk_size> params;
+        const vec4 *pos = points.positions();
+        const vec4f *unit = points.unit();
+        for (size_t c = 0; c < points.count; c++) {
+            params[c] = float(-(double(unit[c].z) * 0.075 - time * 0.2000 - pos[c].w * 1.0 / 18.0));
+        }
+        gradient_engine.repeat(params.data(), out, points.count);
     }
-    return gradient_engine.repeat(-((fixtures.front()->bounds.map_unit(pos) * 0.075 - time * 0.2000 - pos.w * 1.0 / 18.0)).z);
-}
+};
 
-static vec4 justARainbow(const span &, const std::vector<const fixture *> &fixtures, const vec4 &pos, double time) {
-    if (fixtures.size() == 0 || fixtures.front() == nullptr) {
-        return vec4();
+struct justARainbow {
+    static void evaluate(const span &, const point_batch &points, vec4f *out, double time) {
+        std::array<float, scene_chunk_size> params;
+        const vec4f *unit = points.unit();
+        for (size_t c = 0; c < points.count; c++) {
+            params[c] = float(-(double(unit[c].z) * 0.75 - time * 0.2000));
+        }
+        gradient_rainbow.repeat(params.data(), out, points.count);
     }
-    return gradient_rainbow.repeat(-((fixtures.front()->bounds.map_unit(pos) * 0.75 - time * 0.2000)).z);
-}
+};
 
-static vec4 justAGradient(const span &, const std::vector<const fixture *> &fixtures, const vec4 &pos, double time) {
-    if (fixtures.size() == 0 || fixtures.front() == nullptr) {
-        return vec4();
+struct justAGradient {
+    static void evaluate(const span &, const point_batch &points, vec4f *out, double time) {
+        std::array<float, scene_chunk_size> params;
+        const vec4 *pos = points.positions();
+        const vec4f *unit = points.unit();
+        for (size_t c = 0; c < points.count; c++) {
+            params[c] = float(-(double(unit[c].z) * 4.0 + time * 0.2000 - pos[c].w * 2.0 / 18.0));
+        }
+        gradient_ramp.reflect(params.data(), out, points.count);
     }
-    return gradient_ramp.reflect(-((fixtures.front()->bounds.map_unit(pos) * 4.0 + time * 0.2000 - pos.w * 2.0 / 18.0)).z);
-}
+};
 
-static vec4 background(const span &, const std::vector<const fixture *> &fixtures, const vec4 &pos, double) {
-    if (fixtures.size() == 0 || fixtures.front() == nullptr) {
-        return vec4();
+struct background {
+    static void evaluate(const span &, const point_batch &points, vec4f *out, double) {
+        std::array<float, scene_chunk_size> params;
+        const vec4f *unit = points.unit();
+        for (size_t c = 0; c < points.count; c++) {
+            params[c] = unit[c].z;
+        }
+        gradient_engine_bg.clamp(params.data(), out, points.count);
+        for (size_t c = 0; c < points.count; c++) {
+            out[c] *= 0.011111f;
+        }
     }
-    return gradient_engine_bg.clamp((fixtures.front()->bounds.map_unit(pos)).z) * 0.011111;
-}
+};
 
-static vec4 crossFade(const timeline &, const vec4 &top, const vec4 &btm, double in_f, double out_f) {
-    return top * in_f * out_f + btm * (1.0 - ( in_f * out_f) );
+struct crossFade {
+    static vec4f blend(const vec4f &top, const vec4f &btm, float in_f, float out_f) {
+        return top * in_f * out_f + btm * (1.0f - ( in_f * out_f) );
+    }
 };
 
+static void register_effects() {
+    auto &registry = effect_registry::instance();
+    registry.add_effect<engineBlastoff>("engineBlastoff");
+    registry.add_effect<justARainbow>("justARainbow");
+    registry.add_effect<justAGradient>("justAGradient");
+    registry.add_effect<background>("background");
+    registry.add_blender<crossFade>("crossFade");
+}
+
 static timeline effect0({
     timing { 0.0, 600.0 },
-    span{ timing {    0.0,   600.0 }, background },
-    span{ timing {    0.0,   600.0 }, engineBlastoff }
+    span{ timing {    0.0,   600.0 }, effect_of<background>() },
+    span{ timing {    0.0,   600.0 }, effect_of<engineBlastoff>() }
 });
 
 static timeline effect1({
     timing { 0.0, 600.0 },
-    span{ timing {    0.0,   600.0 }, justARainbow },
-    span{ timing {    0.0,   600.0 }, justAGradient }
+    span{ timing {    0.0,   600.0 }, effect_of<justARainbow>() },
+    span{ timing {    0.0,   600.0 }, effect_of<justAGradient>() }
 });
 
 static timeline master({
     timing { 0.0, 120.0 },  
-    timeline { timing {    0.0,  62.0, 2.0, 2.0 }, effect0, std::function(crossFade) },
-    timeline { timing {   60.0,  62.0, 2.0, 2.0 }, effect1, std::function(crossFade) },
+    timeline { timing {    0.0,  62.0, 2.0, 2.0 }, effect0, blender_of<crossFade>() },
+    timeline { timing {   60.0,  62.0, 2.0, 2.0 }, effect1, blender_of<crossFade>() },
 });
 
 static fixture make_vertical_fixture(const std::string &name, const ipv4 &ip, vec4 pos, uint16_t universe0, uint16_t universe1) {
@@ -136,9 +187,182 @@ static fixture global_fixture(
 
 }  // namespace ledstickler {
 
-int main() {
+// ledstickler [--show <file>] [--preview <port>] [--layer <capture>] [--live <port>]
+//                                                  run the built in or a loaded show live,
+//                                                  optionally with a capture added on top and
+//                                                  Art-Net received on port overriding both
+// ledstickler --render <file> [--format leds|artnet] [--duration <s>]
+//                                                  render it offline into a frame file
+// ledstickler --play <file> [--start <s>]          play a rendered frame file live
+//                                                  --preview also serves a browser view on port
+// ledstickler --capture <file> [--duration <s>]    record incoming Art-Net until ^C
+// ledstickler --replay <file> [--to <a.b.c.d>]     send a capture again with its original timing
+//
+// Live output is Art-Net unless --sacn [--priority <n>] [--sync-universe <n>]
+// [--multicast-if <a.b.c.d>] switches it to E1.31, multicast to each
+// universe's group, or --sacn-unicast to each controller.
+int main(int argc, char *argv[]) {
+
+    ledstickler::register_effects();
+
+    std::string show_path;
+    std::string render_path;
+    std::string play_path;
+    double play_start = 0.0;
+    int preview_port = 0;
+    std::string capture_path;
+    std::string replay_path;
+    std::string layer_path;
+    int live_port = -1;
+    ledstickler::replay_options replay;
+    ledstickler::output_kind output = ledstickler::output_kind::artnet;
+    ledstickler::sacn_options sacn;
+    ledstickler::offline_options offline;
+    for (int c = 1; c < argc; c++) {
+        const std::string arg(argv[c]);
+        const bool has_value = c + 1 < argc;
+        if (arg == "--show" && has_value) {
+            show_path = argv[++c];
+        } else if (arg == "--render" && has_value) {
+            render_path = argv[++c];
+        } else if (arg == "--play" && has_value) {
+            play_path = argv[++c];
+        } else if (arg == "--capture" && has_value) {
+            capture_path = argv[++c];
+        } else if (arg == "--replay" && has_value) {
+            replay_path = argv[++c];
+        } else if (arg == "--layer" && has_value) {
+            layer_path = argv[++c];
+        } else if (arg == "--live" && has_value) {
+            live_port = std::atoi(argv[++c]);
+        } else if ((arg == "--to" || arg == "--multicast-if") && has_value) {
+            unsigned a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+            if (sscanf(argv[++c], "%u.%u.%u.%u", &a0, &a1, &a2, &a3) != 4 || a0 > 255 || a1 > 255 || a2 > 255 || a3 > 255) {
+                fprintf(stderr, "bad address '%s'\n", argv[c]);
+                return 1;
+            }
+            (arg == "--to" ? replay.target : sacn.interface) = { uint8_t(a0), uint8_t(a1), uint8_t(a2), uint8_t(a3) };
+        } else if (arg == "--sacn") {
+            output = ledstickler::output_kind::sacn;
+        } else if (arg == "--sacn-unicast") {
+            output = ledstickler::output_kind::sacn;
+            sacn.multicast = false;
+        } else if (arg == "--priority" && has_value) {
+            sacn.priority = uint8_t(std::clamp(std::atoi(argv[++c]), 0, 200));
+        } else if (arg == "--sync-universe" && has_value) {
+            sacn.sync_universe = uint16_t(std::clamp(std::atoi(argv[++c]), 0, int(ledstickler::sacn_universe_max)));
+        } else if (arg == "--preview" && has_value) {
+            preview_port = std::atoi(argv[++c]);
+        } else if (arg == "--start" && has_value) {
+            play_start = std::atof(argv[++c]);
+        } else if (arg == "--format" && has_value) {
+            const std::string format(argv[++c]);
+            offline.format = format == "artnet" ? ledstickler::frame_format::artnet : ledstickler::frame_format::leds;
+        } else if (arg == "--duration" && has_value) {
+            offline.duration = std::atof(argv[++c]);
+        } else {
+            fprintf(stderr, "unknown argument '%s'\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (capture_path.size()) {
+        ledstickler::capture_options capture;
+        capture.duration = offline.duration;
+        return ledstickler::capture_artnet(capture_path, capture) ? 0 : 1;
+    }
+
+    if (replay_path.size()) {
+        if (!ledstickler::replay_capture(replay_path, replay)) {
+            fprintf(stderr, "could not replay '%s'\n", replay_path.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    const ledstickler::fixture *root = &ledstickler::global_fixture;
+    ledstickler::timeline *master = &ledstickler::master;
+    uint64_t frame_time_us = ledstickler::frame_time_us;
+
+    ledstickler::show show;
+    if (show_path.size()) {
+        std::string error;
+        bool cached = false;
+        const auto t0 = std::chrono::steady_clock::now();
+        if (!ledstickler::load_show(show_path, show, error, &cached)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("loaded '%s' in %.2fms%s\n", show_path.c_str(), ms, cached ? " (cached)" : "");
+        root = &show.root;
+        master = &show.master;
+        frame_time_us = show.frame_time_us;
+    }
+
+    ledstickler::scene scene(*root);
+    if (const size_t dropped = ledstickler::artnet_output(scene).dropped) {
+        fprintf(stderr, "%zu points do not fit into their fixtures' universes and are not sent\n", dropped);
+    }
+    offline.frame_time_us = frame_time_us;
+
+    ledstickler::capture_file layer_file;
+    std::unique_ptr<ledstickler::capture_layer> layer;
+    if (layer_path.size()) {
+        if (!layer_file.open(layer_path)) {
+            fprintf(stderr, "could not open capture '%s'\n", layer_path.c_str());
+            return 1;
+        }
+        layer = std::make_unique<ledstickler::capture_layer>(layer_file, scene);
+        if (layer->ambiguous_universes()) {
+            fprintf(stderr, "%zu universe numbers are used by several controllers, their points are left out of the capture layer\n", layer->ambiguous_universes());
+        }
+        master->push(ledstickler::span { ledstickler::timing { 0.0, master->tim.duration }, layer.get() });
+    }
+
+    std::unique_ptr<ledstickler::live_layer> live;
+    if (live_port >= 0) {
+        ledstickler::live_options live_options;
+        live_options.port = uint16_t(std::clamp(live_port, 0, 65535));
+        live = std::make_unique<ledstickler::live_layer>(scene);
+        if (!live->start(live_options)) {
+            fprintf(stderr, "could not listen on port %d\n", int(live_options.port));
+            return 1;
+        }
+        if (live->ambiguous_universes()) {
+            fprintf(stderr, "%zu universe numbers are used by several controllers, their points are left out of the live layer\n", live->ambiguous_universes());
+        }
+        ledstickler::span s { ledstickler::timing { 0.0, master->tim.duration }, live.get() };
+        s.blendMode = ledstickler::blender_of<ledstickler::blend_override>();
+        master->push(s);
+    }
+
+    if (render_path.size()) {
+        if (!master->render_file(scene, render_path, offline)) {
+            fprintf(stderr, "could not write '%s'\n", render_path.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    ledstickler::run_options options;
+    options.frame_time_us = frame_time_us;
+    options.overrun = ledstickler::overrun;
+    options.output.kind = output;
+    options.output.sync = ledstickler::sync_mode;
+    options.output.sync_broadcast = ledstickler::sync_broadcast;
+    options.output.sacn = sacn;
+    options.preview.port = uint16_t(std::clamp(preview_port, 0, 65535));
+
+    if (play_path.size()) {
+        if (!master->play_file(scene, play_path, options, play_start)) {
+            fprintf(stderr, "could not play '%s'\n", play_path.c_str());
+            return 1;
+        }
+        return 0;
+    }
 
-    ledstickler::master.run(ledstickler::global_fixture, ledstickler::frame_time_us);
+    master->run(scene, options);
 	
     return 0;
 }
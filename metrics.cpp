@@ -0,0 +1,134 @@
+#include "./metrics.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <iterator>
+
+#include <fmt/format.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif  // #if defined(_MSC_VER)
+
+namespace ledstickler {
+
+static size_t highest_bit(uint64_t v) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, v);
+    return size_t(index);
+#else  // #if defined(_MSC_VER)
+    return size_t(63 - __builtin_clzll(v));
+#endif  // #if defined(_MSC_VER)
+}
+
+size_t histogram::bucket(uint64_t v) {
+    if (v < sub_count) {
+        return v;
+    }
+    const size_t e = highest_bit(v);
+    const size_t sub = (v >> (e - sub_bits)) & (sub_count - 1);
+    return (e - sub_bits + 1) * sub_count + sub;
+}
+
+uint64_t histogram::bucket_value(size_t index) {
+    if (index < sub_count) {
+        return index;
+    }
+    const size_t e = index / sub_count + sub_bits - 1;
+    const size_t sub = index % sub_count;
+    return (sub_count + sub) << (e - sub_bits);
+}
+
+void histogram::record(uint64_t v) {
+    buckets[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(v, std::memory_order_relaxed);
+    uint64_t m = max.load(std::memory_order_relaxed);
+    while (v > m && !max.compare_exchange_weak(m, v, std::memory_order_relaxed)) { }
+}
+
+histogram::snapshot histogram::read() const {
+    snapshot s;
+    for (size_t c = 0; c < bucket_count; c++) {
+        s.buckets[c] = buckets[c].load(std::memory_order_relaxed);
+        s.count += s.buckets[c];
+    }
+    s.sum = sum.load(std::memory_order_relaxed);
+    s.max = max.load(std::memory_order_relaxed);
+    return s;
+}
+
+uint64_t histogram::snapshot::quantile(double q) const {
+    const uint64_t rank = uint64_t(q * double(count));
+    uint64_t seen = 0;
+    for (size_t c = 0; c < bucket_count; c++) {
+        seen += buckets[c];
+        if (seen > rank) {
+            return bucket_value(c);
+        }
+    }
+    return max;
+}
+
+static void format_histogram(fmt::memory_buffer &out, const char *name, const histogram &h) {
+    const histogram::snapshot s = h.read();
+    const auto us = [](uint64_t ns) { return double(ns) / 1000.0; };
+    fmt::format_to(std::back_inserter(out), "{:<10} {:>10} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f}\n", name, s.count,
+        us(s.count ? s.sum / s.count : 0), us(s.quantile(0.5)), us(s.quantile(0.99)), us(s.quantile(0.999)), us(s.max));
+}
+
+std::string metrics::report() const {
+    fmt::memory_buffer out;
+    const uint64_t color = average_color.load(std::memory_order_relaxed);
+    fmt::format_to(std::back_inserter(out), "time ({:f}s) frames ({}) active spans ({}) average color (r:{:04x} g:{:04x} b:{:04x})\n",
+        time.load(std::memory_order_relaxed), frames.load(std::memory_order_relaxed), active_spans.load(std::memory_order_relaxed),
+        (color >> 32) & 0xFFFF, (color >> 16) & 0xFFFF, color & 0xFFFF);
+    fmt::format_to(std::back_inserter(out), "sent ({}) bytes ({}) calls ({}) eagain ({}) partial ({}) errors ({}) suppressed ({}) late ({}) dropped ({}) skipped ({})\n",
+        packets.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed), send_calls.load(std::memory_order_relaxed),
+        send_again.load(std::memory_order_relaxed), send_partial.load(std::memory_order_relaxed), send_errors.load(std::memory_order_relaxed),
+        suppressed.load(std::memory_order_relaxed), late.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed),
+        skipped.load(std::memory_order_relaxed));
+
+    static constexpr const char *names[] = { "schedule", "evaluate", "convert", "packetize", "send", "sleep" };
+    static_assert(std::size(names) == size_t(metrics_stage::count));
+    fmt::format_to(std::back_inserter(out), "{:<10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}\n", "stage (us)", "count", "mean", "p50", "p99", "p99.9", "max");
+    for (size_t c = 0; c < size_t(metrics_stage::count); c++) {
+        format_histogram(out, names[c], stages[c]);
+    }
+    format_histogram(out, "jitter", jitter);
+    return fmt::to_string(out);
+}
+
+static volatile std::sig_atomic_t dump_requested = 0;
+
+metrics_reporter::metrics_reporter(const metrics &m, double interval) {
+#if defined(SIGUSR1)
+    std::signal(SIGUSR1, [](int) { dump_requested = 1; });
+#endif  // #if defined(SIGUSR1)
+    thread = std::thread([this, &m, interval] {
+        using clock = std::chrono::steady_clock;
+        const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval));
+        clock::time_point next = clock::now() + period;
+        while (!quit.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            const bool due = interval > 0.0 && clock::now() >= next;
+            if (due || dump_requested) {
+                dump_requested = 0;
+                if (due) {
+                    next += period;
+                }
+                const std::string report = m.report();
+                fwrite(report.data(), 1, report.size(), stdout);
+                fflush(stdout);
+            }
+        }
+    });
+}
+
+metrics_reporter::~metrics_reporter() {
+    quit.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+}
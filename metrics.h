@@ -0,0 +1,109 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace ledstickler {
+
+    // Log-linear histogram of nanosecond values, 16 sub-buckets per power of
+    // two so any recorded value is off by at most 1/16. record() is a couple
+    // of relaxed atomic adds and safe from any number of threads.
+    class histogram {
+    public:
+        static constexpr size_t sub_bits = 4;
+        static constexpr size_t sub_count = size_t(1) << sub_bits;
+        static constexpr size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+        void record(uint64_t v);
+
+        // Plain copy for reporting, not atomic as a whole.
+        struct snapshot {
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            uint64_t max = 0;
+            std::array<uint64_t, bucket_count> buckets = { 0 };
+
+            // Lower bound of the bucket holding quantile q (0..1).
+            uint64_t quantile(double q) const;
+        };
+
+        snapshot read() const;
+
+        static size_t bucket(uint64_t v);
+        static uint64_t bucket_value(size_t index);
+
+    private:
+        std::array<std::atomic<uint64_t>, bucket_count> buckets { };
+        std::atomic<uint64_t> sum { 0 };
+        std::atomic<uint64_t> max { 0 };
+    };
+
+    enum class metrics_stage : size_t {
+        schedule,   // timeline::plan
+        evaluate,   // spans and blending, summed over workers
+        convert,    // CIELUV to LED, summed over workers
+        packetize,  // artnet_output::update
+        send,       // udp_sender::flush
+        sleep,      // frame_pacer::wait
+        count
+    };
+
+    // Process wide counters and stage timings. Writers only ever do relaxed
+    // atomic adds, a metrics_reporter reads them from its own thread.
+    class metrics {
+    public:
+        static uint64_t now() {
+            return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        void record(metrics_stage s, uint64_t ns) { stages[size_t(s)].record(ns); }
+        const histogram &stage(metrics_stage s) const { return stages[size_t(s)]; }
+
+        histogram jitter;
+
+        std::atomic<uint64_t> frames { 0 };
+        std::atomic<uint64_t> packets { 0 };
+        std::atomic<uint64_t> bytes { 0 };
+        std::atomic<uint64_t> send_calls { 0 };
+        std::atomic<uint64_t> send_again { 0 };
+        std::atomic<uint64_t> send_partial { 0 };
+        std::atomic<uint64_t> send_errors { 0 };
+        std::atomic<uint64_t> suppressed { 0 };
+        std::atomic<uint64_t> late { 0 };
+        std::atomic<uint64_t> dropped { 0 };
+        std::atomic<uint64_t> skipped { 0 };
+
+        // Gauges of the most recently rendered frame.
+        std::atomic<double> time { 0.0 };
+        std::atomic<uint64_t> active_spans { 0 };
+        std::atomic<uint64_t> average_color { 0 }; // r << 32 | g << 16 | b
+
+        std::string report() const;
+
+    private:
+        std::array<histogram, size_t(metrics_stage::count)> stages;
+    };
+
+    // Prints metrics::report() to stdout every interval seconds (never if 0)
+    // and whenever the process receives SIGUSR1 where that exists.
+    class metrics_reporter {
+    public:
+        metrics_reporter(const metrics &m, double interval);
+        ~metrics_reporter();
+
+        metrics_reporter(const metrics_reporter &) = delete;
+        metrics_reporter &operator=(const metrics_reporter &) = delete;
+
+    private:
+        std::atomic<bool> quit { false };
+        std::thread thread;
+    };
+
+}
+
+#endif  // #ifndef _METRICS_H_
@@ -0,0 +1,152 @@
+#include "./output.h"
+#include "./sender.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+namespace ledstickler {
+
+std::vector<output_universe> output_universes(const artnet_output &output) {
+    std::vector<output_universe> universes;
+    for (const auto &u : output.universes) {
+        universes.push_back({ u.universe, u.f->address.addr() });
+    }
+    return universes;
+}
+
+static std::vector<uint32_t> controller_addresses(const std::vector<output_universe> &universes) {
+    std::vector<uint32_t> controllers;
+    for (const auto &u : universes) {
+        controllers.push_back(u.address);
+    }
+    return controllers;
+}
+
+static bool has_repeated_universes(const std::vector<output_universe> &universes) {
+    std::vector<uint16_t> numbers;
+    for (const auto &u : universes) {
+        numbers.push_back(u.universe);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    return std::adjacent_find(numbers.begin(), numbers.end()) != numbers.end();
+}
+
+// ArtDmx unicast to each universe's controller, latched by ArtSync.
+class artnet_protocol final : public output_protocol {
+public:
+    artnet_protocol(udp_sender &s, const std::vector<output_universe> &universes, const output_options &options) :
+        sender(s),
+        sequence(universes.size()) {
+        for (const auto &u : universes) {
+            headers.push_back(make_artnet_dmx_header(u.universe, 0));
+            endpoints.push_back(sender.add_endpoint(u.address, artnet_port));
+        }
+        for (uint32_t addr : artnet_sync_addresses(controller_addresses(universes), options.sync, options.sync_broadcast)) {
+            sync_endpoints.push_back(sender.add_endpoint(addr, artnet_port));
+        }
+    }
+
+    void queue(size_t index, const uint8_t *dmx, size_t length) override {
+        uint8_t *header = headers[index].data();
+        header[16] = uint8_t( ( length >> 8 ) & 0xFF );
+        header[17] = uint8_t( ( length >> 0 ) & 0xFF );
+        sequence.stamp(index, header);
+        sender.queue(endpoints[index], header, artnet_dmx_header_size, dmx, length);
+    }
+
+    void sync() override {
+        static constexpr auto sync_packet = make_arnet_sync_packet();
+        for (size_t endpoint : sync_endpoints) {
+            sender.queue(endpoint, sync_packet.data(), artnet_sync_packet_size);
+        }
+    }
+
+private:
+    udp_sender &sender;
+    artnet_sequence sequence;
+    std::vector<std::array<uint8_t, artnet_dmx_header_size>> headers;
+    std::vector<size_t> endpoints;
+    std::vector<size_t> sync_endpoints;
+};
+
+// E1.31 data packets, multicast to each universe's group or unicast to its
+// controller, optionally latched by E1.31 synchronization packets.
+class sacn_protocol final : public output_protocol {
+public:
+    sacn_protocol(udp_sender &s, const std::vector<output_universe> &universes, const sacn_options &options) :
+        sender(s),
+        sequence(universes.size(), 0),
+        sync_universe(options.sync_universe) {
+        const sacn_cid cid = make_sacn_cid();
+        // A universe's group carries one stream per source, controllers
+        // reusing universe numbers can only be told apart by address
+        bool multicast = options.multicast;
+        if (multicast && has_repeated_universes(universes)) {
+            fprintf(stderr, "universe numbers repeat across controllers, sending sACN unicast\n");
+            multicast = false;
+        }
+        if (multicast && !sender.set_multicast(options.interface.addr())) {
+            fprintf(stderr, "could not send multicast through %d.%d.%d.%d\n",
+                int(options.interface.a0), int(options.interface.a1), int(options.interface.a2), int(options.interface.a3));
+        }
+        for (const auto &u : universes) {
+            const uint16_t number = uint16_t(std::clamp(u.universe + options.universe_offset, 1, int(sacn_universe_max)));
+            headers.push_back(make_sacn_dmx_header(number, 0, cid, options.source_name.c_str(), options.priority, sync_universe));
+            endpoints.push_back(sender.add_endpoint(multicast ? sacn_multicast_address(number) : u.address, sacn_port));
+        }
+        if (sync_universe) {
+            sync_packet = make_sacn_sync_packet(sync_universe, cid);
+            std::vector<uint32_t> addresses = controller_addresses(universes);
+            if (multicast) {
+                addresses = { sacn_multicast_address(sync_universe) };
+            } else {
+                std::sort(addresses.begin(), addresses.end());
+                addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+            }
+            for (uint32_t addr : addresses) {
+                sync_endpoints.push_back(sender.add_endpoint(addr, sacn_port));
+            }
+        }
+    }
+
+    void queue(size_t index, const uint8_t *dmx, size_t length) override {
+        uint8_t *header = headers[index].data();
+        sacn_set_length(header, uint16_t(length));
+        header[111] = sequence[index]++;
+        sender.queue(endpoints[index], header, sacn_dmx_header_size, dmx, length);
+    }
+
+    void sync() override {
+        if (!sync_universe) {
+            return;
+        }
+        sync_packet[44] = sync_sequence++;
+        for (size_t endpoint : sync_endpoints) {
+            sender.queue(endpoint, sync_packet.data(), sacn_sync_packet_size);
+        }
+    }
+
+private:
+    udp_sender &sender;
+    std::vector<std::array<uint8_t, sacn_dmx_header_size>> headers;
+    std::vector<size_t> endpoints;
+    std::vector<uint8_t> sequence;
+    uint16_t sync_universe = 0;
+    uint8_t sync_sequence = 0;
+    std::array<uint8_t, sacn_sync_packet_size> sync_packet = { 0 };
+    std::vector<size_t> sync_endpoints;
+};
+
+std::unique_ptr<output_protocol> make_output_protocol(udp_sender &sender, const std::vector<output_universe> &universes, const output_options &options) {
+    switch (options.kind) {
+        case output_kind::sacn:
+            return std::make_unique<sacn_protocol>(sender, universes, options.sacn);
+        case output_kind::artnet:
+            break;
+    }
+    return std::make_unique<artnet_protocol>(sender, universes, options);
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include "./artnet.h"
+#include "./fixture.h"
+#include "./sacn.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ledstickler {
+
+    class udp_sender;
+
+    enum class output_kind {
+        artnet,
+        sacn
+    };
+
+    struct sacn_options {
+        bool multicast = true; // one send per universe to its group, otherwise unicast to each controller.
+                               // Falls back to unicast when controllers share universe numbers.
+        ipv4 interface = { 0, 0, 0, 0 }; // multicast interface, 0.0.0.0 lets the routing table pick
+        uint8_t priority = sacn_priority_default;
+        uint16_t sync_universe = 0; // 0 disables E1.31 synchronization
+        uint16_t universe_offset = 1; // sACN has no universe 0, Art-Net universe n goes out as n + offset
+        std::string source_name = "ledstickler";
+    };
+
+    struct output_options {
+        output_kind kind = output_kind::artnet;
+        artnet_sync_mode sync = artnet_sync_mode::per_controller;
+        ipv4 sync_broadcast = { 255, 255, 255, 255 };
+        sacn_options sacn;
+    };
+
+    // Where a universe goes, in the numbering artnet_output uses.
+    struct output_universe {
+        uint16_t universe = 0;
+        uint32_t address = 0;
+    };
+
+    std::vector<output_universe> output_universes(const artnet_output &output);
+
+    // Wire protocol of a frame's universes. A protocol owns the headers and
+    // per universe state like sequence numbers, the DMX payload is gathered
+    // straight from where the packetizer left it, usually an artnet_output
+    // packet or a mapped frame file. Everything is queued on the sender
+    // passed at creation, the caller flushes once per frame.
+    class output_protocol {
+    public:
+        virtual ~output_protocol() = default;
+
+        // Queues universe index. dmx must stay valid until the sender is flushed.
+        virtual void queue(size_t index, const uint8_t *dmx, size_t length) = 0;
+
+        // Queues whatever latches the universes queued since the last sync.
+        virtual void sync() = 0;
+    };
+
+    std::unique_ptr<output_protocol> make_output_protocol(udp_sender &sender, const std::vector<output_universe> &universes, const output_options &options);
+
+}
+
+#endif  // #ifndef _OUTPUT_H_
@@ -0,0 +1,70 @@
+#include "./pacing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace ledstickler {
+
+frame_pacer::frame_pacer(uint64_t frame_time_us, overrun_policy _policy, uint64_t spin_us) :
+    period(std::chrono::microseconds(std::max(frame_time_us, uint64_t(1)))), // wait() divides by it
+    spin(std::chrono::microseconds(spin_us)),
+    policy(_policy),
+    deadline(clock::now()) {
+}
+
+bool frame_pacer::wait() {
+    counters.frames++;
+
+    clock::time_point now = clock::now();
+    if (now > deadline) {
+        counters.late++;
+        const int64_t late_us = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+        counters.jitter_us = late_us;
+        counters.jitter_max_us = std::max(counters.jitter_max_us, late_us);
+        counters.jitter_sum_us += late_us;
+        switch (policy) {
+            case overrun_policy::run_late:
+                return true;
+            case overrun_policy::drop: {
+                // Still within its own period, send it. Otherwise drop it and
+                // realign to the current period so only frames that are
+                // actually behind go, not every frame after a slow one.
+                const auto behind = (now - deadline) / period;
+                if (!behind) {
+                    return true;
+                }
+                counters.dropped++;
+                counters.skipped += uint64_t(behind);
+                deadline += behind * period;
+                return false;
+            }
+            case overrun_policy::skip_ahead: {
+                const auto behind = (now - deadline) / period;
+                counters.skipped += uint64_t(behind);
+                deadline += behind * period;
+                return true;
+            }
+        }
+        return true;
+    }
+
+    if (deadline - now > spin) {
+        std::this_thread::sleep_until(deadline - spin);
+    }
+    while ((now = clock::now()) < deadline) {
+        std::this_thread::yield();
+    }
+
+    const int64_t jitter_us = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+    counters.jitter_us = jitter_us;
+    counters.jitter_max_us = std::max(counters.jitter_max_us, jitter_us);
+    counters.jitter_sum_us += jitter_us;
+    return true;
+}
+
+void frame_pacer::advance() {
+    deadline += period;
+}
+
+}
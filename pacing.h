@@ -0,0 +1,54 @@
+#ifndef _PACING_H_
+#define _PACING_H_
+
+#include <chrono>
+#include <cstdint>
+
+namespace ledstickler {
+
+    // What to do with a frame whose deadline has already passed.
+    enum class overrun_policy {
+        run_late,   // send it anyway, later frames catch up back to back
+        drop,       // send it within its period, past that drop it and move the schedule to the current slot
+        skip_ahead  // send it and move the schedule to the next future slot
+    };
+
+    struct pacing_stats {
+        uint64_t frames = 0;
+        uint64_t late = 0;
+        uint64_t dropped = 0;
+        uint64_t skipped = 0;
+        int64_t jitter_us = 0;      // last wake up relative to the deadline
+        int64_t jitter_max_us = 0;
+        int64_t jitter_sum_us = 0;
+    };
+
+    // Frame clock on steady_clock. Sleeps until shortly before each deadline
+    // and spins the rest of the way. Deadlines advance by whole periods so
+    // the schedule never drifts or jumps with wall clock adjustments.
+    class frame_pacer {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        frame_pacer(uint64_t frame_time_us, overrun_policy policy, uint64_t spin_us);
+
+        // Waits for the current frame's deadline. Returns false if the frame
+        // missed it and the policy says to drop it.
+        bool wait();
+
+        // Moves on to the next frame.
+        void advance();
+
+        const pacing_stats &stats() const { return counters; }
+
+    private:
+        clock::duration period;
+        clock::duration spin;
+        overrun_policy policy;
+        clock::time_point deadline;
+        pacing_stats counters;
+    };
+
+}
+
+#endif  // #ifndef _PACING_H_
@@ -0,0 +1,81 @@
+#include "./pool.h"
+
+#include <algorithm>
+
+namespace ledstickler {
+
+worker_pool::worker_pool(size_t count) {
+    count = std::max(count, size_t(1));
+    for (size_t c = 1; c < count; c++) {
+        threads.emplace_back([this, c] { loop(c); });
+    }
+}
+
+worker_pool::~worker_pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    start_cv.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void worker_pool::run(size_t jobs, const std::function<void (size_t job, size_t worker)> &func) {
+    if (jobs == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job_func = &func;
+        job_count = jobs;
+        job_next.store(0, std::memory_order_relaxed);
+        busy = threads.size();
+        generation++;
+    }
+    start_cv.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return busy == 0; });
+    job_func = nullptr;
+}
+
+void worker_pool::work(size_t worker) {
+    for (;;) {
+        size_t job = job_next.fetch_add(1, std::memory_order_relaxed);
+        if (job >= job_count) {
+            return;
+        }
+        (*job_func)(job, worker);
+    }
+}
+
+void worker_pool::loop(size_t worker) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [this, seen] { return quit || generation != seen; });
+            if (quit) {
+                return;
+            }
+            seen = generation;
+        }
+
+        work(worker);
+
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = --busy == 0;
+        }
+        if (last) {
+            done_cv.notify_one();
+        }
+    }
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ledstickler {
+
+    // Persistent set of worker threads. run() hands out jobs [0, jobs) to
+    // the workers and the calling thread and returns once all of them are
+    // done, so it doubles as the end-of-frame barrier.
+    class worker_pool {
+    public:
+        explicit worker_pool(size_t threads = std::thread::hardware_concurrency());
+        ~worker_pool();
+
+        worker_pool(const worker_pool &) = delete;
+        worker_pool &operator=(const worker_pool &) = delete;
+
+        // Number of distinct worker indices passed to func, the caller included.
+        size_t size() const { return threads.size() + 1; }
+
+        void run(size_t jobs, const std::function<void (size_t job, size_t worker)> &func);
+
+    private:
+        void loop(size_t worker);
+        void work(size_t worker);
+
+        std::vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+
+        const std::function<void (size_t job, size_t worker)> *job_func = nullptr;
+        size_t job_count = 0;
+        std::atomic<size_t> job_next { 0 };
+        uint64_t generation = 0;
+        size_t busy = 0;
+        bool quit = false;
+    };
+
+}
+
+#endif  // #ifndef _POOL_H_
@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wshadow"
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#pragma GCC diagnostic ignored "-Wlogical-op"
+#endif  // #if !defined(__clang__)
+#endif  // #if !defined(_MSC_VER)
+#include <asio.hpp>
+#if !defined(_MSC_VER)
+#pragma GCC diagnostic pop
+#endif  // #if !defined(_MSC_VER)
+
+#include <http_parser.h>
+
+#include "./preview.h"
+#include "./scene.h"
+#include "./snapshot.h"
+
+namespace ledstickler {
+
+static const char preview_page[] = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>ledstickler</title>
+<style>html,body{margin:0;height:100%;background:#000;color:#888;font:12px monospace}canvas{display:block;width:100%;height:100%}#info{position:fixed;left:8px;top:8px}</style>
+</head><body><canvas id="c"></canvas><div id="info"></div><script>
+const canvas = document.getElementById('c'), ctx = canvas.getContext('2d'), info = document.getElementById('info');
+let pos = null, rgb = null, time = 0, yaw = 0.6, pitch = 0.4, drag = null;
+canvas.onmousedown = e => drag = [e.clientX, e.clientY];
+window.onmouseup = () => drag = null;
+window.onmousemove = e => { if (drag) { yaw += (e.clientX - drag[0]) * 0.01; pitch += (e.clientY - drag[1]) * 0.01; drag = [e.clientX, e.clientY]; } };
+function draw() {
+  const w = canvas.width = canvas.clientWidth, h = canvas.height = canvas.clientHeight, s = Math.min(w, h) * 0.45;
+  ctx.fillStyle = '#000'; ctx.fillRect(0, 0, w, h);
+  if (pos && rgb) {
+    const cy = Math.cos(yaw), sy = Math.sin(yaw), cp = Math.cos(pitch), sp = Math.sin(pitch), n = pos.length / 3, d = Math.max(2, s / Math.sqrt(n));
+    for (let i = 0; i < n; i++) {
+      const x = pos[i * 3], y = pos[i * 3 + 1], z = pos[i * 3 + 2];
+      const rx = x * cy - y * sy, ry = x * sy + y * cy;
+      ctx.fillStyle = 'rgb(' + rgb[i * 3] + ',' + rgb[i * 3 + 1] + ',' + rgb[i * 3 + 2] + ')';
+      ctx.fillRect(w / 2 + rx * s - d / 2, h / 2 - (z * cp - ry * sp) * s - d / 2, d, d);
+    }
+  }
+  info.textContent = time.toFixed(2) + 's';
+  requestAnimationFrame(draw);
+}
+fetch('/geometry').then(r => r.arrayBuffer()).then(b => {
+  pos = new Float32Array(b, 4, new DataView(b).getUint32(0, true) * 3);
+  const ws = new WebSocket('ws://' + location.host + '/frames');
+  ws.binaryType = 'arraybuffer';
+  ws.onmessage = m => { time = new DataView(m.data).getFloat64(0, true); rgb = new Uint8Array(m.data, 12); };
+  requestAnimationFrame(draw);
+});
+</script></body></html>
+)";
+
+static std::array<uint32_t, 5> sha1(const std::string &in) {
+    std::array<uint32_t, 5> h = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string m = in;
+    m.push_back(char(0x80));
+    while (m.size() % 64 != 56) {
+        m.push_back(0);
+    }
+    const uint64_t bits = in.size() * 8;
+    for (int c = 7; c >= 0; c--) {
+        m.push_back(char((bits >> (c * 8)) & 0xFF));
+    }
+    auto rol = [](uint32_t v, int s) { return (v << s) | (v >> (32 - s)); };
+    for (size_t block = 0; block < m.size(); block += 64) {
+        std::array<uint32_t, 80> w;
+        for (size_t c = 0; c < 16; c++) {
+            w[c] = (uint32_t(uint8_t(m[block + c * 4 + 0])) << 24) | (uint32_t(uint8_t(m[block + c * 4 + 1])) << 16) |
+                   (uint32_t(uint8_t(m[block + c * 4 + 2])) <<  8) | (uint32_t(uint8_t(m[block + c * 4 + 3])) <<  0);
+        }
+        for (size_t c = 16; c < 80; c++) {
+            w[c] = rol(w[c - 3] ^ w[c - 8] ^ w[c - 14] ^ w[c - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (size_t i = 0; i < 80; i++) {
+            uint32_t f = 0;
+            uint32_t k = 0;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            const uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    return h;
+}
+
+static std::string base64(const uint8_t *data, size_t size) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t c = 0; c < size; c += 3) {
+        const uint32_t v = (uint32_t(data[c]) << 16) |
+                           (c + 1 < size ? uint32_t(data[c + 1]) << 8 : 0) |
+                           (c + 2 < size ? uint32_t(data[c + 2]) : 0);
+        out.push_back(table[(v >> 18) & 0x3F]);
+        out.push_back(table[(v >> 12) & 0x3F]);
+        out.push_back(c + 1 < size ? table[(v >> 6) & 0x3F] : '=');
+        out.push_back(c + 2 < size ? table[v & 0x3F] : '=');
+    }
+    return out;
+}
+
+// Sec-WebSocket-Accept for a client key, RFC 6455 section 4.2.2.
+static std::string websocket_accept(const std::string &key) {
+    const std::array<uint32_t, 5> h = sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    std::array<uint8_t, 20> digest;
+    for (size_t c = 0; c < 20; c++) {
+        digest[c] = uint8_t(h[c / 4] >> (24 - (c % 4) * 8));
+    }
+    return base64(digest.data(), digest.size());
+}
+
+// Unfragmented, unmasked binary message header for a payload of size bytes.
+static size_t websocket_header(uint8_t *out, size_t size) {
+    out[0] = 0x82;
+    if (size < 126) {
+        out[1] = uint8_t(size);
+        return 2;
+    }
+    if (size < 65536) {
+        out[1] = 126;
+        out[2] = uint8_t(size >> 8);
+        out[3] = uint8_t(size);
+        return 4;
+    }
+    out[1] = 127;
+    for (size_t c = 0; c < 8; c++) {
+        out[2 + c] = uint8_t(size >> ((7 - c) * 8));
+    }
+    return 10;
+}
+
+struct preview_frame {
+    double time = 0.0;
+    uint32_t frame = 0;
+    std::vector<uint8_t> rgb;
+};
+
+struct preview_client {
+    explicit preview_client(asio::ip::tcp::socket s) : socket(std::move(s)) { }
+
+    asio::ip::tcp::socket socket;
+    bool writing = false;
+    std::array<uint8_t, 256> in;
+};
+
+struct preview_server::impl {
+    asio::io_service io_service;
+    asio::ip::tcp::acceptor acceptor { io_service };
+    asio::steady_timer timer { io_service };
+    std::thread thread;
+
+    std::chrono::nanoseconds interval;
+    size_t stride = 1;
+    size_t count = 0;
+    std::string geometry;
+    std::array<uint8_t, 4096> srgb;
+
+    // Written by the render thread only
+    std::chrono::steady_clock::time_point next_publish;
+    uint32_t frame = 0;
+
+    snapshot_buffer<preview_frame> frames;
+    std::atomic<size_t> client_count { 0 };
+    std::vector<std::shared_ptr<preview_client>> clients;
+
+    class connection;
+
+    void accept();
+    void tick();
+    void broadcast(const preview_frame &f);
+    void read(const std::shared_ptr<preview_client> &client);
+    void drop(const std::shared_ptr<preview_client> &client);
+};
+
+// One HTTP request, answered and closed or upgraded to a WebSocket client.
+class preview_server::impl::connection : public std::enable_shared_from_this<connection> {
+public:
+    connection(impl &server, asio::ip::tcp::socket s) : p(server), socket(std::move(s)) {
+        http_parser_init(&parser, HTTP_REQUEST);
+        parser.data = this;
+        http_parser_settings_init(&settings);
+        settings.on_url = [](http_parser *hp, const char *at, size_t length) {
+            static_cast<connection *>(hp->data)->url.append(at, length);
+            return 0;
+        };
+        settings.on_header_field = [](http_parser *hp, const char *at, size_t length) {
+            auto *c = static_cast<connection *>(hp->data);
+            if (c->in_value) {
+                c->header_done();
+            }
+            c->field.append(at, length);
+            return 0;
+        };
+        settings.on_header_value = [](http_parser *hp, const char *at, size_t length) {
+            auto *c = static_cast<connection *>(hp->data);
+            c->in_value = true;
+            c->value.append(at, length);
+            return 0;
+        };
+        settings.on_headers_complete = [](http_parser *hp) {
+            auto *c = static_cast<connection *>(hp->data);
+            if (c->in_value) {
+                c->header_done();
+            }
+            return 0;
+        };
+        settings.on_message_complete = [](http_parser *hp) {
+            static_cast<connection *>(hp->data)->complete = true;
+            return 0;
+        };
+    }
+
+    void read() {
+        auto self = shared_from_this();
+        socket.async_read_some(asio::buffer(buffer), [this, self](const asio::error_code &ec, size_t size) {
+            if (ec) {
+                return;
+            }
+            const size_t parsed = http_parser_execute(&parser, &settings, buffer.data(), size);
+            if (parser.http_errno != 0 || (parsed != size && !parser.upgrade) || url.size() > 4096) {
+                respond("400 Bad Request", "text/plain", "bad request\n");
+            } else if (complete) {
+                route();
+            } else {
+                read();
+            }
+        });
+    }
+
+private:
+    void header_done() {
+        std::transform(field.begin(), field.end(), field.begin(), [](char ch) { return char(std::tolower(ch)); });
+        if (field == "sec-websocket-key") {
+            key = value;
+        }
+        field.clear();
+        value.clear();
+        in_value = false;
+    }
+
+    void route() {
+        if (parser.method != HTTP_GET) {
+            respond("405 Method Not Allowed", "text/plain", "GET only\n");
+        } else if (url == "/frames" && parser.upgrade && key.size()) {
+            upgrade();
+        } else if (url == "/" || url == "/index.html") {
+            respond("200 OK", "text/html; charset=utf-8", preview_page);
+        } else if (url == "/geometry") {
+            respond("200 OK", "application/octet-stream", p.geometry);
+        } else {
+            respond("404 Not Found", "text/plain", "not found\n");
+        }
+    }
+
+    void respond(const char *status, const char *type, const std::string &body) {
+        response = std::string("HTTP/1.1 ") + status + "\r\n" +
+            "Content-Type: " + type + "\r\n" +
+            "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+            "Cache-Control: no-cache\r\n" +
+            "Connection: close\r\n\r\n" + body;
+        auto self = shared_from_this();
+        asio::async_write(socket, asio::buffer(response), [this, self](const asio::error_code &, size_t) {
+            asio::error_code ignored;
+            socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+        });
+    }
+
+    void upgrade() {
+        response = "HTTP/1.1 101 Switching Protocols\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: " + websocket_accept(key) + "\r\n\r\n";
+        auto self = shared_from_this();
+        asio::async_write(socket, asio::buffer(response), [this, self](const asio::error_code &ec, size_t) {
+            if (ec) {
+                return;
+            }
+            asio::error_code ignored;
+            socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+            auto client = std::make_shared<preview_client>(std::move(socket));
+            p.clients.push_back(client);
+            p.client_count.store(p.clients.size(), std::memory_order_relaxed);
+            p.read(client);
+        });
+    }
+
+    impl &p;
+    asio::ip::tcp::socket socket;
+    http_parser parser;
+    http_parser_settings settings;
+    std::array<char, 4096> buffer;
+    std::string url;
+    std::string field;
+    std::string value;
+    std::string key;
+    std::string response;
+    bool in_value = false;
+    bool complete = false;
+};
+
+void preview_server::impl::accept() {
+    acceptor.async_accept([this](const asio::error_code &ec, asio::ip::tcp::socket socket) {
+        if (ec == asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            std::make_shared<connection>(*this, std::move(socket))->read();
+        }
+        accept();
+    });
+}
+
+void preview_server::impl::tick() {
+    timer.expires_after(interval);
+    timer.async_wait([this](const asio::error_code &ec) {
+        if (ec) {
+            return;
+        }
+        if (frames.fetch()) {
+            broadcast(frames.front());
+        }
+        tick();
+    });
+}
+
+// Clients still busy with an earlier frame skip this one, so a slow browser
+// only ever holds back its own stream.
+void preview_server::impl::broadcast(const preview_frame &f) {
+    auto message = std::make_shared<std::vector<uint8_t>>(10 + 12 + f.rgb.size());
+    uint8_t *out = message->data();
+    const size_t head = websocket_header(out, 12 + f.rgb.size());
+    memcpy(out + head, &f.time, sizeof(f.time));
+    memcpy(out + head + 8, &f.frame, sizeof(f.frame));
+    memcpy(out + head + 12, f.rgb.data(), f.rgb.size());
+    message->resize(head + 12 + f.rgb.size());
+    for (const auto &client : clients) {
+        if (client->writing) {
+            continue;
+        }
+        client->writing = true;
+        asio::async_write(client->socket, asio::buffer(*message), [this, client, message](const asio::error_code &ec, size_t) {
+            client->writing = false;
+            if (ec) {
+                drop(client);
+            }
+        });
+    }
+}
+
+// Nothing the browser sends is needed, reading only notices close frames
+// and dead connections.
+void preview_server::impl::read(const std::shared_ptr<preview_client> &client) {
+    client->socket.async_read_some(asio::buffer(client->in), [this, client](const asio::error_code &ec, size_t size) {
+        if (ec || (size > 0 && (client->in[0] & 0x0F) == 0x08)) {
+            drop(client);
+            return;
+        }
+        read(client);
+    });
+}
+
+void preview_server::impl::drop(const std::shared_ptr<preview_client> &client) {
+    auto it = std::find(clients.begin(), clients.end(), client);
+    if (it == clients.end()) {
+        return;
+    }
+    clients.erase(it);
+    client_count.store(clients.size(), std::memory_order_relaxed);
+    asio::error_code ignored;
+    client->socket.close(ignored);
+}
+
+preview_server::preview_server(const scene &s, const preview_options &options) : p(std::make_unique<impl>()) {
+    p->interval = std::chrono::nanoseconds(int64_t(1e9 / std::max(options.max_fps, 0.1)));
+    p->stride = std::max((s.size() + options.max_points - 1) / std::max(options.max_points, size_t(1)), size_t(1));
+    p->count = (s.size() + p->stride - 1) / p->stride;
+
+    const uint32_t count = uint32_t(p->count);
+    p->geometry.resize(sizeof(count) + p->count * 3 * sizeof(float));
+    memcpy(&p->geometry[0], &count, sizeof(count));
+    for (size_t c = 0; c < p->count; c++) {
+        const vec4 pos = s.bounds.map_norm_uniform(s.positions[c * p->stride]);
+        const float xyz[3] = { float(pos.x), float(pos.y), float(pos.z) };
+        memcpy(&p->geometry[sizeof(count) + c * sizeof(xyz)], xyz, sizeof(xyz));
+    }
+
+    // LED values are linear, the browser wants sRGB
+    for (size_t c = 0; c < p->srgb.size(); c++) {
+        const double v = double(c) / double(p->srgb.size() - 1);
+        const double e = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+        p->srgb[c] = uint8_t(std::lround(std::clamp(e, 0.0, 1.0) * 255.0));
+    }
+
+    for (auto &f : p->frames.all()) {
+        f.rgb.resize(p->count * 3);
+    }
+
+    asio::error_code ec;
+    const asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), options.port);
+    p->acceptor.open(endpoint.protocol(), ec);
+    if (!ec) {
+        p->acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+        p->acceptor.bind(endpoint, ec);
+    }
+    if (!ec) {
+        p->acceptor.listen(asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        fprintf(stderr, "preview: could not listen on port %d: %s\n", int(options.port), ec.message().c_str());
+        return;
+    }
+    printf("preview: http://localhost:%d/ (%zu points)\n", int(options.port), p->count);
+
+    p->accept();
+    p->tick();
+    p->thread = std::thread([this] {
+        p->io_service.run();
+    });
+}
+
+preview_server::~preview_server() {
+    p->io_service.stop();
+    if (p->thread.joinable()) {
+        p->thread.join();
+    }
+}
+
+void preview_server::publish(const scene &s, double time) {
+    if (p->client_count.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now < p->next_publish) {
+        return;
+    }
+    p->next_publish = now + p->interval;
+
+    preview_frame &f = p->frames.back();
+    f.time = time;
+    f.frame = p->frame++;
+    const rgba<uint16_t> *leds = s.leds.data();
+    uint8_t *out = f.rgb.data();
+    for (size_t c = 0; c < p->count; c++) {
+        const rgba<uint16_t> &l = leds[c * p->stride];
+        out[c * 3 + 0] = p->srgb[l.r >> 4];
+        out[c * 3 + 1] = p->srgb[l.g >> 4];
+        out[c * 3 + 2] = p->srgb[l.b >> 4];
+    }
+    p->frames.publish();
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef _PREVIEW_H_
+#define _PREVIEW_H_
+
+#include <cstdint>
+#include <memory>
+
+namespace ledstickler {
+
+    class scene;
+
+    struct preview_options {
+        uint16_t port = 0; // 0 disables the preview
+        double max_fps = 30.0; // frames streamed per second at most
+        size_t max_points = 65'536; // larger scenes are decimated to about this many points
+    };
+
+    // Embedded HTTP server for watching a show from a browser. It serves a
+    // viewer page at /, the point positions once at /geometry and then
+    // streams frames as binary WebSocket messages from /frames. All network
+    // I/O runs on its own thread; the render thread only hands over frames.
+    //
+    //   /geometry  uint32 count, then count * float32 x, y, z in -1..1
+    //   /frames    float64 show time, uint32 frame number, count * uint8 r, g, b
+    //
+    // Everything is little endian and uses the same decimated points.
+    class preview_server {
+    public:
+        preview_server(const scene &s, const preview_options &options);
+        ~preview_server();
+
+        preview_server(const preview_server &) = delete;
+        preview_server &operator=(const preview_server &) = delete;
+
+        // Called by the render thread after every frame. Returns right away
+        // unless a client is connected and the next frame is due, and never
+        // blocks on the network.
+        void publish(const scene &s, double time);
+
+    private:
+        struct impl;
+        std::unique_ptr<impl> p;
+    };
+
+}
+
+#endif  // #ifndef _PREVIEW_H_
@@ -0,0 +1,188 @@
+#include <vector>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+
+#if !defined(_MSC_VER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wshadow"
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#pragma GCC diagnostic ignored "-Wlogical-op"
+#endif  // #if !defined(__clang__)
+#endif  // #if !defined(_MSC_VER)
+#include <asio.hpp>
+#if !defined(_MSC_VER)
+#pragma GCC diagnostic pop
+#endif  // #if !defined(_MSC_VER)
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <time.h>
+#include <cstring>
+#endif  // #if defined(__linux__)
+
+#include "./receiver.h"
+
+namespace ledstickler {
+
+static uint64_t steady_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct udp_receiver::impl {
+    asio::io_service io_service;
+    asio::ip::udp::socket socket { io_service };
+
+    std::vector<uint8_t> ring = std::vector<uint8_t>(slot_count * slot_size);
+    std::array<received_packet, slot_count> packets;
+    uint64_t drops = 0;
+
+#if defined(__linux__)
+    // Room for a receive timestamp and the drop counter per datagram
+    static constexpr size_t control_size = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t));
+
+    std::array<mmsghdr, slot_count> msgs;
+    std::array<iovec, slot_count> iovs;
+    std::array<sockaddr_in, slot_count> addrs;
+    std::vector<uint8_t> control = std::vector<uint8_t>(slot_count * control_size);
+
+    void setup() {
+        const int fd = socket.native_handle();
+        // Art-Net bursts a whole frame of universes at once, give the kernel room to queue them
+        int size = 8 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+        setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    }
+
+    size_t receive(int timeout_ms) {
+        const int fd = socket.native_handle();
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            return 0;
+        }
+        for (size_t c = 0; c < slot_count; c++) {
+            iovs[c].iov_base = &ring[c * slot_size];
+            iovs[c].iov_len = slot_size;
+            memset(&msgs[c], 0, sizeof(mmsghdr));
+            msgs[c].msg_hdr.msg_name = &addrs[c];
+            msgs[c].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[c].msg_hdr.msg_iov = &iovs[c];
+            msgs[c].msg_hdr.msg_iovlen = 1;
+            msgs[c].msg_hdr.msg_control = &control[c * control_size];
+            msgs[c].msg_hdr.msg_controllen = control_size;
+        }
+        int res = 0;
+        do {
+            res = recvmmsg(fd, msgs.data(), static_cast<unsigned int>(slot_count), MSG_DONTWAIT, nullptr);
+        } while (res < 0 && errno == EINTR);
+        if (res <= 0) {
+            return 0;
+        }
+
+        // Kernel timestamps are wall clock, move them onto the steady clock
+        timespec real;
+        clock_gettime(CLOCK_REALTIME, &real);
+        const uint64_t now = steady_ns();
+        const int64_t offset = int64_t(now) - (real.tv_sec * INT64_C(1'000'000'000) + real.tv_nsec);
+
+        for (size_t c = 0; c < size_t(res); c++) {
+            received_packet &p = packets[c];
+            p.data = &ring[c * slot_size];
+            p.size = msgs[c].msg_len;
+            p.address = ntohl(addrs[c].sin_addr.s_addr);
+            p.time_ns = now;
+            for (cmsghdr *cm = CMSG_FIRSTHDR(&msgs[c].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[c].msg_hdr, cm)) {
+                if (cm->cmsg_level != SOL_SOCKET) {
+                    continue;
+                }
+                if (cm->cmsg_type == SO_TIMESTAMPNS) {
+                    timespec ts;
+                    memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+                    const int64_t t = ts.tv_sec * INT64_C(1'000'000'000) + ts.tv_nsec + offset;
+                    p.time_ns = uint64_t(std::min(t, int64_t(now)));
+                } else if (cm->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t count = 0;
+                    memcpy(&count, CMSG_DATA(cm), sizeof(count));
+                    drops = count;
+                }
+            }
+        }
+        return size_t(res);
+    }
+#else  // #if defined(__linux__)
+    void setup() {
+        socket.set_option(asio::socket_base::receive_buffer_size(8 << 20));
+        socket.non_blocking(true);
+    }
+
+    size_t receive(int timeout_ms) {
+        const uint64_t deadline = steady_ns() + uint64_t(timeout_ms) * 1'000'000;
+        size_t count = 0;
+        while (count < slot_count) {
+            asio::error_code ec;
+            asio::ip::udp::endpoint from;
+            const size_t size = socket.receive_from(asio::buffer(&ring[count * slot_size], slot_size), from, 0, ec);
+            if (ec == asio::error::would_block || ec == asio::error::try_again) {
+                if (count || steady_ns() >= deadline) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            if (ec) {
+                break;
+            }
+            received_packet &p = packets[count++];
+            p.data = &ring[(count - 1) * slot_size];
+            p.size = size;
+            p.address = from.address().to_v4().to_uint();
+            p.time_ns = steady_ns();
+        }
+        return count;
+    }
+#endif  // #if defined(__linux__)
+};
+
+udp_receiver::udp_receiver() : p(std::make_unique<impl>()) {
+}
+
+udp_receiver::~udp_receiver() {
+    asio::error_code ec;
+    p->socket.close(ec);
+}
+
+bool udp_receiver::open(uint16_t port) {
+    asio::error_code ec;
+    const asio::ip::udp::endpoint endpoint(asio::ip::udp::v4(), port);
+    p->socket.open(endpoint.protocol(), ec);
+    if (!ec) {
+        p->socket.set_option(asio::socket_base::reuse_address(true), ec);
+        p->socket.bind(endpoint, ec);
+    }
+    if (ec) {
+        return false;
+    }
+    p->setup();
+    return true;
+}
+
+size_t udp_receiver::receive(const received_packet *&packets, int timeout_ms) {
+    packets = p->packets.data();
+    return p->receive(timeout_ms);
+}
+
+uint64_t udp_receiver::dropped() const {
+    return p->drops;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef _RECEIVER_H_
+#define _RECEIVER_H_
+
+#include <cstdint>
+#include <memory>
+
+namespace ledstickler {
+
+    // A datagram in the receiver's ring. time_ns is on the steady_clock
+    // (metrics::now), taken by the kernel on arrival where supported.
+    struct received_packet {
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        uint32_t address = 0;
+        uint64_t time_ns = 0;
+    };
+
+    // UDP receiver filling a fixed ring of packet slots. On Linux a single
+    // recvmmsg call fills as many slots as there are datagrams queued, with
+    // kernel receive timestamps and the socket's drop counter. Elsewhere it
+    // falls back to one receive_from per datagram. Nothing is copied, the
+    // returned packets point into the ring until the next receive().
+    class udp_receiver {
+    public:
+        static constexpr size_t slot_count = 1024;
+        static constexpr size_t slot_size = 1024; // larger datagrams are truncated
+
+        udp_receiver();
+        ~udp_receiver();
+
+        udp_receiver(const udp_receiver &) = delete;
+        udp_receiver &operator=(const udp_receiver &) = delete;
+
+        // Binds to port on all interfaces. Returns false if that fails.
+        bool open(uint16_t port);
+
+        // Waits up to timeout_ms for at least one datagram, then returns
+        // everything queued up to slot_count. Returns 0 on timeout.
+        size_t receive(const received_packet *&packets, int timeout_ms);
+
+        // Datagrams the kernel dropped because the socket buffer was full,
+        // 0 where the platform does not tell.
+        uint64_t dropped() const;
+
+    private:
+        struct impl;
+        std::unique_ptr<impl> p;
+    };
+
+}
+
+#endif  // #ifndef _RECEIVER_H_
@@ -0,0 +1,18 @@
+#include "./sacn.h"
+
+#include <random>
+
+namespace ledstickler {
+
+sacn_cid make_sacn_cid() {
+    std::random_device rd;
+    sacn_cid cid = { 0 };
+    for (uint8_t &b : cid) {
+        b = uint8_t(rd() & 0xFF);
+    }
+    cid[6] = uint8_t((cid[6] & 0x0F) | 0x40); // version 4
+    cid[8] = uint8_t((cid[8] & 0x3F) | 0x80); // RFC 4122 variant
+    return cid;
+}
+
+}
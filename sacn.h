@@ -0,0 +1,128 @@
+#ifndef _SACN_H_
+#define _SACN_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ledstickler {
+
+    // ANSI E1.31 (sACN), DMX over ACN, see
+    // https://tsp.esta.org/tsp/documents/docs/ANSI_E1-31-2018.pdf
+
+    constexpr uint16_t sacn_port = 5568;
+    constexpr size_t sacn_dmx_header_size = 126; // up to and including the DMX start code
+    constexpr size_t sacn_sync_packet_size = 49;
+    constexpr uint16_t sacn_universe_max = 63999;
+    constexpr uint8_t sacn_priority_default = 100;
+
+    using sacn_cid = std::array<uint8_t, 16>;
+
+    // A random version 4 UUID identifying this sender to receivers.
+    sacn_cid make_sacn_cid();
+
+    // Multicast group of a universe, 239.255.hi.lo.
+    constexpr uint32_t sacn_multicast_address(uint16_t universe) {
+        return (uint32_t(239) << 24) | (uint32_t(255) << 16) | universe;
+    }
+
+    constexpr void sacn_write_root(uint8_t *packet, size_t size, uint32_t vector, const sacn_cid &cid) {
+        constexpr char acn_packet_id[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+        packet[ 0] = 0x00; // preamble size
+        packet[ 1] = 0x10;
+        packet[ 2] = 0x00; // postamble size
+        packet[ 3] = 0x00;
+        for (size_t c = 0; c < 12; c++) {
+            packet[4 + c] = uint8_t(acn_packet_id[c]);
+        }
+        packet[16] = uint8_t( 0x70 | ( ( ( size - 16 ) >> 8 ) & 0x0F ) );
+        packet[17] = uint8_t( ( size - 16 ) & 0xFF );
+        packet[18] = uint8_t( ( vector >> 24 ) & 0xFF );
+        packet[19] = uint8_t( ( vector >> 16 ) & 0xFF );
+        packet[20] = uint8_t( ( vector >>  8 ) & 0xFF );
+        packet[21] = uint8_t( ( vector >>  0 ) & 0xFF );
+        for (size_t c = 0; c < cid.size(); c++) {
+            packet[22 + c] = cid[c];
+        }
+    }
+
+    // Rewrites the PDU lengths of a data header for length DMX slots.
+    constexpr void sacn_set_length(uint8_t *header, uint16_t length) {
+        const size_t size = sacn_dmx_header_size + length;
+        header[ 16] = uint8_t( 0x70 | ( ( ( size -  16 ) >> 8 ) & 0x0F ) );
+        header[ 17] = uint8_t( ( size -  16 ) & 0xFF );
+        header[ 38] = uint8_t( 0x70 | ( ( ( size -  38 ) >> 8 ) & 0x0F ) );
+        header[ 39] = uint8_t( ( size -  38 ) & 0xFF );
+        header[115] = uint8_t( 0x70 | ( ( ( size - 115 ) >> 8 ) & 0x0F ) );
+        header[116] = uint8_t( ( size - 115 ) & 0xFF );
+        header[123] = uint8_t( ( ( length + 1 ) >> 8 ) & 0xFF ); // property values, start code included
+        header[124] = uint8_t( ( length + 1 ) & 0xFF );
+    }
+
+    // Everything of an E1.31 data packet before the DMX slots. The PDU
+    // lengths depend on the slot count, sacn_set_length() rewrites them.
+    // Sequence number is byte 111.
+    constexpr std::array<uint8_t, sacn_dmx_header_size> make_sacn_dmx_header(uint16_t universe, uint16_t length, const sacn_cid &cid,
+                                                                              const char *source_name, uint8_t priority, uint16_t sync_universe) {
+        std::array<uint8_t, sacn_dmx_header_size> header = { 0 };
+
+        constexpr uint32_t vector_root_e131_data = 0x00000004;
+        constexpr uint32_t vector_e131_data_packet = 0x00000002;
+        constexpr uint8_t vector_dmp_set_property = 0x02;
+
+        sacn_write_root(header.data(), sacn_dmx_header_size + length, vector_root_e131_data, cid);
+
+        header.at( 40) = uint8_t( ( vector_e131_data_packet >> 24 ) & 0xFF );
+        header.at( 41) = uint8_t( ( vector_e131_data_packet >> 16 ) & 0xFF );
+        header.at( 42) = uint8_t( ( vector_e131_data_packet >>  8 ) & 0xFF );
+        header.at( 43) = uint8_t( ( vector_e131_data_packet >>  0 ) & 0xFF );
+        for (size_t c = 0; c < 63 && source_name[c]; c++) {
+            header.at(44 + c) = uint8_t(source_name[c]);
+        }
+        header.at(108) = priority;
+        header.at(109) = uint8_t( ( sync_universe >> 8 ) & 0xFF );
+        header.at(110) = uint8_t( ( sync_universe >> 0 ) & 0xFF );
+        header.at(111) = 0; // seq
+        header.at(112) = 0; // options
+        header.at(113) = uint8_t( ( universe >> 8 ) & 0xFF );
+        header.at(114) = uint8_t( ( universe >> 0 ) & 0xFF );
+
+        header.at(117) = vector_dmp_set_property;
+        header.at(118) = 0xa1; // address and data type
+        header.at(119) = 0x00; // first property address
+        header.at(120) = 0x00;
+        header.at(121) = 0x00; // address increment
+        header.at(122) = 0x01;
+        header.at(125) = 0x00; // DMX start code
+
+        sacn_set_length(header.data(), length);
+
+        return header;
+    }
+
+    // E1.31 synchronization packet. Sequence number is byte 44.
+    constexpr std::array<uint8_t, sacn_sync_packet_size> make_sacn_sync_packet(uint16_t sync_universe, const sacn_cid &cid) {
+        std::array<uint8_t, sacn_sync_packet_size> packet = { 0 };
+
+        constexpr uint32_t vector_root_e131_extended = 0x00000008;
+        constexpr uint32_t vector_e131_extended_synchronization = 0x00000001;
+
+        sacn_write_root(packet.data(), sacn_sync_packet_size, vector_root_e131_extended, cid);
+
+        packet.at(38) = uint8_t( 0x70 | ( ( ( sacn_sync_packet_size - 38 ) >> 8 ) & 0x0F ) );
+        packet.at(39) = uint8_t( ( sacn_sync_packet_size - 38 ) & 0xFF );
+        packet.at(40) = uint8_t( ( vector_e131_extended_synchronization >> 24 ) & 0xFF );
+        packet.at(41) = uint8_t( ( vector_e131_extended_synchronization >> 16 ) & 0xFF );
+        packet.at(42) = uint8_t( ( vector_e131_extended_synchronization >>  8 ) & 0xFF );
+        packet.at(43) = uint8_t( ( vector_e131_extended_synchronization >>  0 ) & 0xFF );
+        packet.at(44) = 0; // seq
+        packet.at(45) = uint8_t( ( sync_universe >> 8 ) & 0xFF );
+        packet.at(46) = uint8_t( ( sync_universe >> 0 ) & 0xFF );
+
+        return packet;
+    }
+
+}
+
+#endif  // #ifndef _SACN_H_
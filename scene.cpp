@@ -0,0 +1,64 @@
+#include "./scene.h"
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+namespace ledstickler {
+
+scene::scene(const fixture &root) : bounds(root.bounds) {
+    size_t point_count = 0;
+    root.walk_fixtures( [this, &point_count] (const std::vector<const fixture *> &fixtures_stack) {
+        point_count += fixtures_stack.front()->points.size();
+        levels = std::max(levels, fixtures_stack.size());
+    });
+
+    positions.reserve(point_count);
+    colors.resize(point_count);
+    leds.resize(point_count, rgba<uint16_t>());
+    fixture_index.reserve(point_count);
+
+    // Same visiting order as the tree walk always had: children first, then the fixture's own points.
+    root.walk_fixtures( [this] (const std::vector<const fixture *> &fixtures_stack) {
+        const auto &ft = *fixtures_stack.front();
+        if (ft.points.size() == 0) {
+            return;
+        }
+        scene_fixture sf;
+        sf.f = &ft;
+        sf.stack = fixtures_stack;
+        sf.first = positions.size();
+        sf.count = ft.points.size();
+        for (const auto &p : ft.points) {
+            positions.push_back(p);
+            fixture_index.push_back(uint32_t(fixtures.size()));
+        }
+        for (size_t c = 0; c < sf.count; c += scene_chunk_size) {
+            scene_chunk chunk;
+            chunk.fixture = uint32_t(fixtures.size());
+            chunk.first = sf.first + c;
+            chunk.count = std::min(scene_chunk_size, sf.count - c);
+            chunks.push_back(chunk);
+        }
+        fixtures.push_back(std::move(sf));
+    });
+
+    // Positions and bounds never change, so the per point mapping is done once here
+    units.resize(levels * point_count);
+    norms.resize(levels * point_count);
+    norm_uniforms.resize(levels * point_count);
+    for (const auto &sf : fixtures) {
+        for (size_t level = 0; level < levels; level++) {
+            const bounds6 &b = sf.stack[std::min(level, sf.stack.size() - 1)]->bounds;
+            for (size_t c = sf.first; c < sf.first + sf.count; c++) {
+                const size_t i = level * point_count + c;
+                units[i] = vec4f(b.map_unit(positions[c]));
+                norms[i] = vec4f(b.map_norm(positions[c]));
+                norm_uniforms[i] = vec4f(b.map_norm_uniform(positions[c]));
+            }
+        }
+    }
+}
+
+}
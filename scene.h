@@ -0,0 +1,67 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include "./vec4.h"
+#include "./vec4f.h"
+#include "./bounds.h"
+#include "./fixture.h"
+#include "./color.h"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace ledstickler {
+
+    // A fixture which owns points, with its ancestor chain resolved once.
+    // stack.front() is the fixture itself, stack.back() the root.
+    struct scene_fixture {
+        const fixture *f = nullptr;
+        std::vector<const fixture *> stack;
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    // Contiguous run of points from a single fixture, the unit of work
+    // handed to the render workers.
+    struct scene_chunk {
+        uint32_t fixture = 0;
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    constexpr size_t scene_chunk_size = 256;
+
+    // Flattened, structure-of-arrays form of a fixture tree. Compiled once
+    // at startup, the render loop only touches these contiguous buffers.
+    class scene {
+    public:
+        explicit scene(const fixture &root);
+
+        size_t size() const { return positions.size(); }
+
+        // Normalized coordinates of every point relative to its ancestors.
+        // Level 0 is the owning fixture, levels past a point's own depth
+        // repeat the root, so level levels - 1 is always the root.
+        const vec4f *unit(size_t level = 0) const { return &units[std::min(level, levels - 1) * size()]; }
+        const vec4f *norm(size_t level = 0) const { return &norms[std::min(level, levels - 1) * size()]; }
+        const vec4f *norm_uniform(size_t level = 0) const { return &norm_uniforms[std::min(level, levels - 1) * size()]; }
+
+        bounds6 bounds;
+        std::vector<scene_fixture> fixtures;
+        std::vector<scene_chunk> chunks;
+
+        std::vector<vec4> positions;
+        std::vector<vec4f> colors;
+        std::vector<rgba<uint16_t>> leds;
+        std::vector<uint32_t> fixture_index;
+
+        size_t levels = 1;
+        std::vector<vec4f> units;
+        std::vector<vec4f> norms;
+        std::vector<vec4f> norm_uniforms;
+    };
+
+}
+
+#endif  // #ifndef _SCENE_H_
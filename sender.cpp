@@ -0,0 +1,183 @@
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+
+#if !defined(_MSC_VER)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wshadow"
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#pragma GCC diagnostic ignored "-Wlogical-op"
+#endif  // #if !defined(__clang__)
+#endif  // #if !defined(_MSC_VER)
+#include <asio.hpp>
+#if !defined(_MSC_VER)
+#pragma GCC diagnostic pop
+#endif  // #if !defined(_MSC_VER)
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstring>
+#endif  // #if defined(__linux__)
+
+#include "./sender.h"
+
+namespace ledstickler {
+
+struct udp_sender::impl {
+    asio::io_service io_service;
+    asio::ip::udp::socket socket { io_service };
+
+    struct queued {
+        size_t endpoint;
+        const void *data;
+        size_t size;
+        const void *body;
+        size_t body_size;
+    };
+    std::vector<queued> queue;
+
+#if defined(__linux__)
+    // Keep the kernel's batch limit, larger frames go out in several calls.
+    static constexpr size_t max_batch = 1024;
+
+    std::vector<sockaddr_in> endpoints;
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+
+    size_t add_endpoint(uint32_t addr, uint16_t port) {
+        sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(port);
+        sa.sin_addr.s_addr = htonl(addr);
+        endpoints.push_back(sa);
+        return endpoints.size() - 1;
+    }
+
+    send_stats flush() {
+        send_stats stats;
+        if (msgs.size() < queue.size()) {
+            msgs.resize(queue.size());
+            iovs.resize(queue.size() * 2);
+        }
+        for (size_t c = 0; c < queue.size(); c++) {
+            iovec *iov = &iovs[c * 2];
+            iov[0].iov_base = const_cast<void *>(queue[c].data);
+            iov[0].iov_len = queue[c].size;
+            iov[1].iov_base = const_cast<void *>(queue[c].body);
+            iov[1].iov_len = queue[c].body_size;
+            memset(&msgs[c], 0, sizeof(mmsghdr));
+            msgs[c].msg_hdr.msg_name = &endpoints[queue[c].endpoint];
+            msgs[c].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[c].msg_hdr.msg_iov = iov;
+            msgs[c].msg_hdr.msg_iovlen = queue[c].body_size ? 2 : 1;
+        }
+        const int fd = socket.native_handle();
+        for (size_t sent = 0; sent < queue.size(); ) {
+            const size_t batch = std::min(queue.size() - sent, max_batch);
+            stats.calls++;
+            int res = sendmmsg(fd, &msgs[sent], static_cast<unsigned int>(batch), 0);
+            if (res < 0) {
+                if (errno == EAGAIN) {
+                    // Socket buffer is full, whatever is left of this frame is stale by the next one.
+                    stats.again++;
+                    break;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                // Drop the offending packet and carry on with the rest.
+                stats.errors++;
+                sent++;
+                continue;
+            }
+            if (size_t(res) < batch) {
+                stats.partial++;
+            }
+            for (size_t c = sent; c < sent + size_t(res); c++) {
+                stats.packets++;
+                stats.bytes += msgs[c].msg_len;
+            }
+            sent += size_t(res);
+        }
+        queue.clear();
+        return stats;
+    }
+#else  // #if defined(__linux__)
+    std::vector<asio::ip::udp::endpoint> endpoints;
+
+    size_t add_endpoint(uint32_t addr, uint16_t port) {
+        endpoints.emplace_back(asio::ip::make_address_v4(addr), port);
+        return endpoints.size() - 1;
+    }
+
+    send_stats flush() {
+        send_stats stats;
+        for (const auto &item : queue) {
+            asio::error_code ec;
+            stats.calls++;
+            const std::array<asio::const_buffer, 2> buffers { asio::buffer(item.data, item.size), asio::buffer(item.body, item.body_size) };
+            size_t res = socket.send_to(buffers, endpoints[item.endpoint], 0, ec);
+            if (ec == asio::error::would_block || ec == asio::error::try_again) {
+                stats.again++;
+            } else if (ec) {
+                stats.errors++;
+            } else {
+                if (res < item.size + item.body_size) {
+                    stats.partial++;
+                }
+                stats.packets++;
+                stats.bytes += res;
+            }
+        }
+        queue.clear();
+        return stats;
+    }
+#endif  // #if defined(__linux__)
+};
+
+udp_sender::udp_sender() : p(std::make_unique<impl>()) {
+    p->socket.open(asio::ip::udp::v4());
+    p->socket.non_blocking(true);
+    p->socket.set_option(asio::socket_base::broadcast(true));
+}
+
+udp_sender::~udp_sender() {
+    asio::error_code ec;
+    p->socket.close(ec);
+}
+
+size_t udp_sender::add_endpoint(uint32_t addr, uint16_t port) {
+    return p->add_endpoint(addr, port);
+}
+
+bool udp_sender::set_multicast(uint32_t interface_addr, uint8_t ttl) {
+    asio::error_code ec;
+    p->socket.set_option(asio::ip::multicast::hops(ttl), ec);
+    p->socket.set_option(asio::ip::multicast::enable_loopback(true), ec);
+    if (interface_addr) {
+        p->socket.set_option(asio::ip::multicast::outbound_interface(asio::ip::address_v4(interface_addr)), ec);
+        return !ec;
+    }
+    return true;
+}
+
+void udp_sender::queue(size_t endpoint, const void *data, size_t size) {
+    p->queue.push_back({endpoint, data, size, nullptr, 0});
+}
+
+void udp_sender::queue(size_t endpoint, const void *head, size_t head_size, const void *body, size_t body_size) {
+    p->queue.push_back({endpoint, head, head_size, body, body_size});
+}
+
+send_stats udp_sender::flush() {
+    return p->flush();
+}
+
+}
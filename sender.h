@@ -0,0 +1,60 @@
+#ifndef _SENDER_H_
+#define _SENDER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ledstickler {
+
+    struct send_stats {
+        size_t packets = 0;
+        size_t bytes = 0;
+        size_t calls = 0;
+        size_t partial = 0;
+        size_t again = 0;
+        size_t errors = 0;
+
+        send_stats &operator+=(const send_stats &b) {
+            packets += b.packets;
+            bytes += b.bytes;
+            calls += b.calls;
+            partial += b.partial;
+            again += b.again;
+            errors += b.errors;
+            return *this;
+        }
+    };
+
+    // Non-blocking UDP sender. Endpoints are resolved once up front, a frame
+    // worth of packets is queued and then submitted with as few syscalls as
+    // the platform allows (sendmmsg on Linux, one send_to per packet elsewhere).
+    // Queued data is not copied and must stay valid until flush() returns.
+    class udp_sender {
+    public:
+        udp_sender();
+        ~udp_sender();
+
+        udp_sender(const udp_sender &) = delete;
+        udp_sender &operator=(const udp_sender &) = delete;
+
+        size_t add_endpoint(uint32_t addr, uint16_t port);
+
+        // Multicast sends leave through interface_addr, 0 lets the routing
+        // table pick, and live for ttl hops. Returns false if the interface
+        // can not be used.
+        bool set_multicast(uint32_t interface_addr, uint8_t ttl = 1);
+
+        void queue(size_t endpoint, const void *data, size_t size);
+        // Gathers head and body into one datagram without copying either.
+        void queue(size_t endpoint, const void *head, size_t head_size, const void *body, size_t body_size);
+        send_stats flush();
+
+    private:
+        struct impl;
+        std::unique_ptr<impl> p;
+    };
+
+}
+
+#endif  // #ifndef _SENDER_H_
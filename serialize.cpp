@@ -0,0 +1,118 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <fmt/compile.h>
+
+#include "./serialize.h"
+#include "./scene.h"
+
+namespace ledstickler {
+
+uint16_t float_to_half(float f) {
+    uint32_t x = 0;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7FFFFFFF;
+    if (x >= 0x7F800000) {
+        return uint16_t(sign | 0x7C00 | (x > 0x7F800000 ? 0x0200 : 0));
+    }
+    // 65520 and up rounds past the largest half
+    if (x >= 0x477FF000) {
+        return uint16_t(sign | 0x7C00);
+    }
+    if (x < 0x38800000) {
+        float a = 0.0f;
+        memcpy(&a, &x, sizeof(a));
+        return uint16_t(sign | uint32_t(std::nearbyint(a * 16777216.0f)));
+    }
+    uint32_t h = (x - 0x38000000) >> 13;
+    const uint32_t rest = x & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+        h++;
+    }
+    return uint16_t(sign | h);
+}
+
+// bounds6::map_norm_uniform with the per point divisions hoisted out.
+struct norm_uniform_map {
+    explicit norm_uniform_map(const bounds6 &b) {
+        const vec4 e = b.extent();
+        const double m = e.max();
+        scale = m >= std::numeric_limits<double>::epsilon() ? 2.0 / m : 0.0;
+        offset = vec4(b.xmin + e.x * 0.5, b.ymin + e.y * 0.5, b.zmin + e.z * 0.5);
+    }
+
+    vec4 operator()(const vec4 &v) const {
+        return vec4((v.x - offset.x) * scale, (v.y - offset.y) * scale, (v.z - offset.z) * scale);
+    }
+
+    double scale = 0.0;
+    vec4 offset;
+};
+
+static void write_header(uint8_t *out, const char (&magic)[5], uint32_t count) {
+    const uint16_t version = serialize_version;
+    const uint16_t reserved = 0;
+    memcpy(out + 0, magic, 4);
+    memcpy(out + 4, &version, sizeof(version));
+    memcpy(out + 6, &reserved, sizeof(reserved));
+    memcpy(out + 8, &count, sizeof(count));
+}
+
+void write_geometry(const scene &s, std::vector<uint8_t> &out) {
+    out.resize(geometry_header_size + s.size() * 3 * sizeof(uint16_t));
+    uint8_t *data = out.data();
+    write_header(data, "LSGM", uint32_t(s.size()));
+    const uint32_t reserved = 0;
+    memcpy(data + 12, &reserved, sizeof(reserved));
+    const bounds6 nu = s.bounds.norm_uniform();
+    const float bounds[6] = { float(nu.xmin), float(nu.xmax), float(nu.ymin), float(nu.ymax), float(nu.zmin), float(nu.zmax) };
+    memcpy(data + 16, bounds, sizeof(bounds));
+    const norm_uniform_map map(s.bounds);
+    uint8_t *points = data + geometry_header_size;
+    for (size_t c = 0; c < s.size(); c++) {
+        const vec4 p = map(s.positions[c]);
+        const uint16_t xyz[3] = { float_to_half(float(p.x)), float_to_half(float(p.y)), float_to_half(float(p.z)) };
+        memcpy(points + c * sizeof(xyz), xyz, sizeof(xyz));
+    }
+}
+
+void write_frame(const scene &s, double time, std::vector<uint8_t> &out) {
+    out.resize(frame_header_size + s.size() * 3 * sizeof(uint16_t));
+    uint8_t *data = out.data();
+    write_header(data, "LSFR", uint32_t(s.size()));
+    memcpy(data + 12, &time, sizeof(time));
+    uint8_t *colors = data + frame_header_size;
+    for (size_t c = 0; c < s.size(); c++) {
+        const rgba<uint16_t> &l = s.leds[c];
+        const uint16_t rgb[3] = { l.r, l.g, l.b };
+        memcpy(colors + c * sizeof(rgb), rgb, sizeof(rgb));
+    }
+}
+
+void write_json(const scene &s, fmt::memory_buffer &out) {
+    out.clear();
+    auto it = fmt::appender(out);
+    const bounds6 nu = s.bounds.norm_uniform();
+    fmt::format_to(it, "{{\n\t\"bounds\":{{\n\t\t\"xmin\":{:.6g},\n\t\t\"xmax\":{:.6g},\n\t\t\"ymin\":{:.6g},\n\t\t\"ymax\":{:.6g},\n\t\t\"zmin\":{:.6g},\n\t\t\"zmax\":{:.6g}\n\t}},\n",
+        nu.xmin, nu.xmax, nu.ymin, nu.ymax, nu.zmin, nu.zmax);
+    fmt::format_to(it, "\t\"points\":[");
+    const norm_uniform_map map(s.bounds);
+    const char *separator = "\n";
+    for (const auto &sf : s.fixtures) {
+        if (!sf.f->name.size()) {
+            continue;
+        }
+        for (size_t c = sf.first; c < sf.first + sf.count; c++) {
+            const vec4 p = map(s.positions[c]);
+            const rgba<uint16_t> &col = s.leds[c];
+            fmt::format_to(it, FMT_COMPILE("{}\t\t{{\"x\":{},\"y\":{},\"z\":{},\"r\":{},\"g\":{},\"b\":{}}}"),
+                separator, float(p.x), float(p.y), float(p.z), col.r, col.g, col.b);
+            separator = ",\n";
+        }
+    }
+    fmt::format_to(it, "\n\t]\n}}\n");
+}
+
+}
@@ -0,0 +1,40 @@
+#ifndef _SERIALIZE_H_
+#define _SERIALIZE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace ledstickler {
+
+    class scene;
+
+    // Binary dumps of a scene for external tools, little endian, every point
+    // in scene order so frames index straight into the geometry. Readers
+    // check magic and version, new fields only ever get appended.
+    //
+    //   geometry  "LSGM", uint16 version, uint16 0, uint32 count, uint32 0,
+    //             float32 xmin, xmax, ymin, ymax, zmin, zmax (norm_uniform bounds),
+    //             count * float16 x, y, z normalized to -1..1
+    //   frame     "LSFR", uint16 version, uint16 0, uint32 count, float64 time,
+    //             count * uint16 r, g, b as sent to the LEDs
+    //
+    // Both replace the contents of out and reuse its storage.
+    constexpr uint16_t serialize_version = 1;
+    constexpr size_t geometry_header_size = 40;
+    constexpr size_t frame_header_size = 20;
+
+    void write_geometry(const scene &s, std::vector<uint8_t> &out);
+    void write_frame(const scene &s, double time, std::vector<uint8_t> &out);
+
+    // Same content as JSON, bounds plus position and color of every point of
+    // a named fixture.
+    void write_json(const scene &s, fmt::memory_buffer &out);
+
+    // IEEE 754 binary16, rounded to nearest even.
+    uint16_t float_to_half(float f);
+
+}
+
+#endif  // #ifndef _SERIALIZE_H_
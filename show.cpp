@@ -0,0 +1,612 @@
+#include "./show.h"
+#include "./json.h"
+#include "./effect.h"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <type_traits>
+
+namespace ledstickler {
+
+enum class gradient_mode { repeat, reflect, clamp };
+
+template<gradient_mode M> struct gradientEffect {
+    static void evaluate(const span &s, const point_batch &points, vec4f *out, double time) {
+        if (!s.grad) {
+            std::fill(out, out + points.count, vec4f());
+            return;
+        }
+        const vec4f k(s.param0);
+        const float offset = float(s.param1.x * time + s.param1.y);
+        std::array<float, scene_chunk_size> params;
+        const vec4 *pos = points.positions();
+        const vec4f *unit = points.unit();
+        for (size_t c = 0; c < points.count; c++) {
+            params[c] = k.x * unit[c].x + k.y * unit[c].y + k.z * unit[c].z + k.w * float(pos[c].w) + offset;
+        }
+        if constexpr (M == gradient_mode::repeat) {
+            s.grad->repeat(params.data(), out, points.count);
+        } else if constexpr (M == gradient_mode::reflect) {
+            s.grad->reflect(params.data(), out, points.count);
+        } else {
+            s.grad->clamp(params.data(), out, points.count);
+        }
+        const float scale = float(s.param1.z);
+        for (size_t c = 0; c < points.count; c++) {
+            out[c] *= scale;
+        }
+    }
+};
+
+static void register_builtin_effects() {
+    auto &registry = effect_registry::instance();
+    registry.add_effect<gradientEffect<gradient_mode::repeat>>("gradientRepeat");
+    registry.add_effect<gradientEffect<gradient_mode::reflect>>("gradientReflect");
+    registry.add_effect<gradientEffect<gradient_mode::clamp>>("gradientClamp");
+}
+
+// Gradient stops as written in the show, kept so the cache can rebuild the
+// tables without the JSON.
+struct show_gradient {
+    std::string name;
+    std::vector<vec4> stops;
+};
+
+static uint64_t fnv1a(const std::string &data) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : data) {
+        h ^= uint8_t(c);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// ---- compiled binary form ----
+
+static constexpr char cache_magic[8] = { 'L', 'S', 'S', 'H', 'O', 'W', 0, 0 };
+static constexpr uint32_t cache_version = 1;
+
+class cache_writer {
+public:
+    template<typename T> void put(const T &v) {
+        static_assert(std::is_trivially_copyable<T>::value, "plain data only");
+        const size_t at = data.size();
+        data.resize(at + sizeof(T));
+        memcpy(&data[at], &v, sizeof(T));
+    }
+
+    void put(const std::string &s) {
+        put(uint32_t(s.size()));
+        data.insert(data.end(), s.begin(), s.end());
+    }
+
+    template<typename T> void put(const std::vector<T> &v) {
+        static_assert(std::is_trivially_copyable<T>::value, "plain data only");
+        put(uint32_t(v.size()));
+        const size_t at = data.size();
+        data.resize(at + v.size() * sizeof(T));
+        if (v.size()) {
+            memcpy(&data[at], v.data(), v.size() * sizeof(T));
+        }
+    }
+
+    std::string data;
+};
+
+class cache_reader {
+public:
+    explicit cache_reader(const std::string &_data) : data(_data) { }
+
+    template<typename T> bool get(T &v) {
+        static_assert(std::is_trivially_copyable<T>::value, "plain data only");
+        if (data.size() - at < sizeof(T)) {
+            return false;
+        }
+        memcpy(&v, &data[at], sizeof(T));
+        at += sizeof(T);
+        return true;
+    }
+
+    bool get(std::string &s) {
+        uint32_t n = 0;
+        if (!get(n) || data.size() - at < n) {
+            return false;
+        }
+        s.assign(data, at, n);
+        at += n;
+        return true;
+    }
+
+    template<typename T> bool get(std::vector<T> &v) {
+        uint32_t n = 0;
+        if (!get(n) || (data.size() - at) / sizeof(T) < n) {
+            return false;
+        }
+        v.resize(n);
+        if (n) {
+            memcpy(v.data(), &data[at], n * sizeof(T));
+        }
+        at += n * sizeof(T);
+        return true;
+    }
+
+    bool done() const { return at == data.size(); }
+
+private:
+    const std::string &data;
+    size_t at = 0;
+};
+
+static void put_timing(cache_writer &w, const timing &t) {
+    w.put(t.start);
+    w.put(t.duration);
+    w.put(t.lead_in);
+    w.put(t.lead_out);
+}
+
+static bool get_timing(cache_reader &r, timing &t) {
+    return r.get(t.start) && r.get(t.duration) && r.get(t.lead_in) && r.get(t.lead_out);
+}
+
+static void put_fixture(cache_writer &w, const fixture &f) {
+    w.put(f.name);
+    w.put(f.address);
+    w.put(f.format);
+    w.put(f.properties);
+    w.put(f.universes);
+    w.put(f.points);
+    w.put(uint32_t(f.fixtures.size()));
+    for (const auto &child : f.fixtures) {
+        put_fixture(w, child);
+    }
+}
+
+static bool get_fixture(cache_reader &r, fixture &f, int depth) {
+    uint32_t children = 0;
+    if (depth > 64 || !r.get(f.name) || !r.get(f.address) || !r.get(f.format) || !r.get(f.properties) ||
+        !r.get(f.universes) || !r.get(f.points) || !r.get(children)) {
+        return false;
+    }
+    for (const auto &p : f.points) {
+        f.bounds.add(p);
+    }
+    for (uint32_t c = 0; c < children; c++) {
+        fixture child;
+        if (!get_fixture(r, child, depth + 1)) {
+            return false;
+        }
+        f.push(child);
+    }
+    return true;
+}
+
+static int32_t gradient_index(const show &s, const gradient<> *g) {
+    for (size_t c = 0; c < s.gradients.size(); c++) {
+        if (s.gradients[c].get() == g) {
+            return int32_t(c);
+        }
+    }
+    return -1;
+}
+
+static void put_timeline(cache_writer &w, const show &sh, const timeline &t) {
+    const auto &registry = effect_registry::instance();
+    put_timing(w, t.tim);
+    w.put(registry.blender_name(t.blendMode));
+    w.put(uint32_t(t.spans.size()));
+    for (const auto &s : t.spans) {
+        put_timing(w, s.tim);
+        w.put(registry.effect_name(s.calcEffect));
+        w.put(registry.blender_name(s.blendMode));
+        w.put(gradient_index(sh, s.grad));
+        w.put(s.param0);
+        w.put(s.param1);
+        w.put(s.param2);
+        w.put(s.param3);
+    }
+    w.put(uint32_t(t.timelines.size()));
+    for (const auto &child : t.timelines) {
+        put_timeline(w, sh, child);
+    }
+}
+
+static bool resolve(const std::string &effect_name, const std::string &blender_name, const effect **e, const blender **b, std::string &error) {
+    const auto &registry = effect_registry::instance();
+    if (e) {
+        *e = registry.find_effect(effect_name);
+        if (!*e) {
+            error = "unknown effect '" + effect_name + "'";
+            return false;
+        }
+    }
+    *b = blender_name.size() ? registry.find_blender(blender_name) : blender_of<blend_add>();
+    if (!*b) {
+        error = "unknown blend mode '" + blender_name + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool get_timeline(cache_reader &r, const show &sh, timeline &t, int depth, std::string &error) {
+    std::string blend;
+    uint32_t spans = 0;
+    if (depth > 64 || !get_timing(r, t.tim) || !r.get(blend) || !r.get(spans)) {
+        return false;
+    }
+    if (!resolve(std::string(), blend, nullptr, &t.blendMode, error)) {
+        return false;
+    }
+    for (uint32_t c = 0; c < spans; c++) {
+        span s;
+        std::string effect_name;
+        std::string blender_name;
+        int32_t grad = -1;
+        if (!get_timing(r, s.tim) || !r.get(effect_name) || !r.get(blender_name) || !r.get(grad) ||
+            !r.get(s.param0) || !r.get(s.param1) || !r.get(s.param2) || !r.get(s.param3)) {
+            return false;
+        }
+        if (!resolve(effect_name, blender_name, &s.calcEffect, &s.blendMode, error)) {
+            return false;
+        }
+        if (grad >= int32_t(sh.gradients.size())) {
+            return false;
+        }
+        s.grad = grad >= 0 ? sh.gradients[size_t(grad)].get() : nullptr;
+        t.push(s);
+    }
+    uint32_t timelines = 0;
+    if (!r.get(timelines)) {
+        return false;
+    }
+    for (uint32_t c = 0; c < timelines; c++) {
+        timeline child;
+        if (!get_timeline(r, sh, child, depth + 1, error)) {
+            return false;
+        }
+        t.push(child);
+    }
+    return true;
+}
+
+static void add_gradient(show &sh, const show_gradient &g) {
+    sh.gradient_names.push_back(g.name);
+    sh.gradients.push_back(std::make_unique<gradient<>>(g.stops.data(), g.stops.size()));
+}
+
+static std::string compile(const show &sh, const std::vector<show_gradient> &gradients, uint64_t hash) {
+    cache_writer w;
+    w.put(cache_magic);
+    w.put(cache_version);
+    w.put(hash);
+    w.put(sh.frame_time_us);
+    w.put(uint32_t(gradients.size()));
+    for (const auto &g : gradients) {
+        w.put(g.name);
+        w.put(g.stops);
+    }
+    put_fixture(w, sh.root);
+    put_timeline(w, sh, sh.master);
+    return std::move(w.data);
+}
+
+// False if the cache is stale or damaged. An effect renamed since the cache
+// was written also lands here, parsing the JSON then reports it properly.
+static bool load_compiled(const std::string &data, uint64_t hash, show &sh) {
+    cache_reader r(data);
+    char magic[8] = { 0 };
+    uint32_t version = 0;
+    uint64_t cached_hash = 0;
+    uint32_t gradients = 0;
+    if (!r.get(magic) || memcmp(magic, cache_magic, sizeof(magic)) != 0 ||
+        !r.get(version) || version != cache_version ||
+        !r.get(cached_hash) || cached_hash != hash ||
+        !r.get(sh.frame_time_us) || !r.get(gradients)) {
+        return false;
+    }
+    for (uint32_t c = 0; c < gradients; c++) {
+        show_gradient g;
+        if (!r.get(g.name) || !r.get(g.stops) || g.stops.size() < 2) {
+            return false;
+        }
+        add_gradient(sh, g);
+    }
+    std::string ignored;
+    return get_fixture(r, sh.root, 0) && get_timeline(r, sh, sh.master, 0, ignored) && r.done();
+}
+
+// ---- JSON form ----
+
+static bool parse_vec4(const json_value *v, vec4 &out) {
+    if (!v || v->kind != json_value::array || v->items.size() < 3 || v->items.size() > 4) {
+        return false;
+    }
+    double c[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (size_t i = 0; i < v->items.size(); i++) {
+        if (v->items[i].kind != json_value::number) {
+            return false;
+        }
+        c[i] = v->items[i].n;
+    }
+    out = vec4(c[0], c[1], c[2], c[3]);
+    return true;
+}
+
+static bool parse_ipv4(const std::string &s, ipv4 &out) {
+    unsigned a[4] = { 0, 0, 0, 0 };
+    char tail = 0;
+    if (sscanf(s.c_str(), "%u.%u.%u.%u%c", &a[0], &a[1], &a[2], &a[3], &tail) != 4 || a[0] > 255 || a[1] > 255 || a[2] > 255 || a[3] > 255) {
+        return false;
+    }
+    out = ipv4 { uint8_t(a[0]), uint8_t(a[1]), uint8_t(a[2]), uint8_t(a[3]) };
+    return true;
+}
+
+static bool parse_format(const std::string &s, pixel_format &out) {
+    static const std::pair<const char *, pixel_format> formats[] = {
+        { "rgb16", pixel_format::rgb16 }, { "rgb8", pixel_format::rgb8 },
+        { "grb16", pixel_format::grb16 }, { "grb8", pixel_format::grb8 },
+        { "rgbw16", pixel_format::rgbw16 }, { "rgbw8", pixel_format::rgbw8 } };
+    for (const auto &f : formats) {
+        if (s == f.first) {
+            out = f.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_timing(const json_value &v, timing &t) {
+    const json_value *duration = v.find("duration");
+    if (!duration || duration->kind != json_value::number) {
+        return false;
+    }
+    t.start = v.number_or("start", 0.0);
+    t.duration = duration->n;
+    t.lead_in = v.number_or("lead_in", 0.0);
+    t.lead_out = v.number_or("lead_out", 0.0);
+    return true;
+}
+
+static bool parse_gradient(const std::string &name, const json_value &v, show_gradient &g, std::string &error) {
+    g.name = name;
+    if (v.kind != json_value::array || v.items.size() < 2) {
+        error = "gradient '" + name + "' needs at least two stops";
+        return false;
+    }
+    for (const auto &stop : v.items) {
+        const json_value *pos = stop.find("pos");
+        const json_value *srgb = stop.find("srgb");
+        const json_value *luv = stop.find("luv");
+        vec4 c;
+        if (!pos || pos->kind != json_value::number) {
+            error = "gradient '" + name + "' stop without pos";
+            return false;
+        }
+        if (srgb && parse_vec4(srgb, c)) {
+            g.stops.push_back(srgb8_stop(rgba<uint8_t>(uint8_t(std::clamp(c.x, 0.0, 255.0)), uint8_t(std::clamp(c.y, 0.0, 255.0)), uint8_t(std::clamp(c.z, 0.0, 255.0))), pos->n));
+        } else if (luv && parse_vec4(luv, c)) {
+            g.stops.push_back(vec4(c.x, c.y, c.z, pos->n));
+        } else {
+            error = "gradient '" + name + "' stop needs srgb or luv";
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_fixture(const json_value &v, fixture &f, int depth, std::string &error) {
+    if (depth > 64 || v.kind != json_value::object) {
+        error = "fixture must be an object";
+        return false;
+    }
+    f.name = v.string_or("name", "");
+    const std::string ip = v.string_or("ip", "");
+    if (ip.size() && !parse_ipv4(ip, f.address)) {
+        error = "fixture '" + f.name + "' has invalid ip '" + ip + "'";
+        return false;
+    }
+    const std::string format = v.string_or("format", "rgb16");
+    if (!parse_format(format, f.format)) {
+        error = "fixture '" + f.name + "' has unknown format '" + format + "'";
+        return false;
+    }
+    if (const json_value *universes = v.find("universes")) {
+        for (const auto &u : universes->items) {
+            if (u.kind != json_value::number || u.n < 0.0 || u.n > 32767.0) {
+                error = "fixture '" + f.name + "' has an invalid universe";
+                return false;
+            }
+            f.push(uint16_t(u.n));
+        }
+    }
+    if (const json_value *properties = v.find("properties")) {
+        if (!parse_vec4(properties, f.properties)) {
+            error = "fixture '" + f.name + "' has invalid properties";
+            return false;
+        }
+    }
+    if (const json_value *strip = v.find("strip")) {
+        vec4 pos;
+        vec4 step;
+        const double count = strip->number_or("count", -1.0);
+        if (!parse_vec4(strip->find("start"), pos) || !parse_vec4(strip->find("step"), step) || count < 0.0) {
+            error = "fixture '" + f.name + "' has an invalid strip";
+            return false;
+        }
+        f.points.reserve(f.points.size() + size_t(count));
+        for (size_t c = 0; c < size_t(count); c++) {
+            f.push(pos);
+            pos += step;
+        }
+    }
+    if (const json_value *points = v.find("points")) {
+        f.points.reserve(f.points.size() + points->items.size());
+        for (const auto &p : points->items) {
+            vec4 pos;
+            if (!parse_vec4(&p, pos)) {
+                error = "fixture '" + f.name + "' has an invalid point";
+                return false;
+            }
+            f.push(pos);
+        }
+    }
+    if (const json_value *children = v.find("fixtures")) {
+        for (const auto &c : children->items) {
+            fixture child;
+            if (!parse_fixture(c, child, depth + 1, error)) {
+                return false;
+            }
+            f.push(child);
+        }
+    }
+    return true;
+}
+
+static bool parse_timeline(const json_value &v, const show &sh, timeline &t, int depth, std::string &error) {
+    if (depth > 64 || !parse_timing(v, t.tim)) {
+        error = "timeline needs a duration";
+        return false;
+    }
+    if (!resolve(std::string(), v.string_or("blend", ""), nullptr, &t.blendMode, error)) {
+        return false;
+    }
+    if (const json_value *spans = v.find("spans")) {
+        for (const auto &item : spans->items) {
+            span s;
+            if (!parse_timing(item, s.tim)) {
+                error = "span needs a duration";
+                return false;
+            }
+            if (!resolve(item.string_or("effect", ""), item.string_or("blend", ""), &s.calcEffect, &s.blendMode, error)) {
+                return false;
+            }
+            const std::string grad = item.string_or("gradient", "");
+            if (grad.size()) {
+                for (size_t c = 0; c < sh.gradient_names.size(); c++) {
+                    if (sh.gradient_names[c] == grad) {
+                        s.grad = sh.gradients[c].get();
+                    }
+                }
+                if (!s.grad) {
+                    error = "unknown gradient '" + grad + "'";
+                    return false;
+                }
+            }
+            if (const json_value *params = item.find("params")) {
+                vec4 *dst[4] = { &s.param0, &s.param1, &s.param2, &s.param3 };
+                for (size_t c = 0; c < params->items.size() && c < 4; c++) {
+                    if (!parse_vec4(&params->items[c], *dst[c])) {
+                        error = "span has invalid params";
+                        return false;
+                    }
+                }
+            }
+            t.push(s);
+        }
+    }
+    if (const json_value *timelines = v.find("timelines")) {
+        for (const auto &item : timelines->items) {
+            timeline child;
+            if (!parse_timeline(item, sh, child, depth + 1, error)) {
+                return false;
+            }
+            t.push(child);
+        }
+    }
+    return true;
+}
+
+static bool parse_show(const std::string &text, show &sh, std::vector<show_gradient> &gradients, std::string &error) {
+    json_value doc;
+    if (!json_parse(text, doc, error)) {
+        return false;
+    }
+    sh.frame_time_us = uint64_t(std::max(doc.number_or("frame_time_us", 10'000.0), 1.0));
+    if (const json_value *grads = doc.find("gradients")) {
+        for (const auto &item : grads->members) {
+            show_gradient g;
+            if (!parse_gradient(item.first, item.second, g, error)) {
+                return false;
+            }
+            add_gradient(sh, g);
+            gradients.push_back(std::move(g));
+        }
+    }
+    if (const json_value *fixtures = doc.find("fixtures")) {
+        for (const auto &item : fixtures->items) {
+            fixture f;
+            if (!parse_fixture(item, f, 1, error)) {
+                return false;
+            }
+            sh.root.push(f);
+        }
+    }
+    const json_value *master = doc.find("timeline");
+    if (!master) {
+        error = "show has no timeline";
+        return false;
+    }
+    return parse_timeline(*master, sh, sh.master, 0, error);
+}
+
+static bool read_file(const std::string &path, std::string &out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    out = ss.str();
+    return true;
+}
+
+bool load_show(const std::string &path, show &out, std::string &error, bool *from_cache) {
+    register_builtin_effects();
+
+    std::string text;
+    if (!read_file(path, text)) {
+        error = "can not read '" + path + "'";
+        return false;
+    }
+    const uint64_t hash = fnv1a(text);
+    const std::string cache_path = path + ".cache";
+
+    std::string compiled;
+    if (read_file(cache_path, compiled)) {
+        show sh;
+        if (load_compiled(compiled, hash, sh)) {
+            out = std::move(sh);
+            if (from_cache) {
+                *from_cache = true;
+            }
+            return true;
+        }
+    }
+
+    show sh;
+    std::vector<show_gradient> gradients;
+    if (!parse_show(text, sh, gradients, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+
+    // Best effort, a read only show directory just means parsing every time
+    compiled = compile(sh, gradients, hash);
+    const std::string tmp_path = cache_path + ".tmp";
+    {
+        std::ofstream cache(tmp_path, std::ios::binary | std::ios::trunc);
+        cache.write(compiled.data(), std::streamsize(compiled.size()));
+    }
+    std::rename(tmp_path.c_str(), cache_path.c_str());
+
+    out = std::move(sh);
+    if (from_cache) {
+        *from_cache = false;
+    }
+    return true;
+}
+
+}
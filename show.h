@@ -0,0 +1,41 @@
+#ifndef _SHOW_H_
+#define _SHOW_H_
+
+#include "./fixture.h"
+#include "./gradient.h"
+#include "./timeline.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ledstickler {
+
+    // A patch and its cue timeline loaded at runtime. Spans point into
+    // gradients, so a show is moved around, never copied.
+    struct show {
+        show() = default;
+        show(show &&) = default;
+        show &operator=(show &&) = default;
+
+        fixture root;
+        timeline master;
+        uint64_t frame_time_us = 10'000;
+        std::vector<std::string> gradient_names;
+        std::vector<std::unique_ptr<gradient<>>> gradients;
+    };
+
+    // Loads a JSON show file. Next to it a compiled binary form is kept in
+    // path + ".cache", keyed by a hash of the JSON text, and used instead of
+    // parsing whenever it matches. Effects and blend modes are looked up by
+    // name in the effect_registry, so register them before loading. Besides
+    // those the show can use the built in gradientRepeat, gradientReflect and
+    // gradientClamp effects, which look up the span's gradient at
+    //   dot(param0, (unit.x, unit.y, unit.z, pos.w)) + param1.x * time + param1.y
+    // and scale the result by param1.z.
+    bool load_show(const std::string &path, show &out, std::string &error, bool *from_cache = nullptr);
+
+}
+
+#endif  // #ifndef _SHOW_H_
@@ -0,0 +1,49 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ledstickler {
+
+    // Triple buffer handing the latest value from one writer thread to one
+    // reader thread. Both sides are wait-free: the writer fills back() and
+    // publishes it, the reader picks up the newest published value, if any,
+    // and reads it at leisure from front(). Values in between are dropped.
+    template<typename T> class snapshot_buffer {
+    public:
+        T &back() { return buffers[back_index]; }
+
+        void publish() {
+            back_index = uint8_t(state.exchange(uint8_t(back_index | fresh), std::memory_order_acq_rel) & index_mask);
+        }
+
+        // Returns false if nothing was published since the last call, front()
+        // then still holds the previous value.
+        bool fetch() {
+            if (!(state.load(std::memory_order_relaxed) & fresh)) {
+                return false;
+            }
+            front_index = uint8_t(state.exchange(front_index, std::memory_order_acq_rel) & index_mask);
+            return true;
+        }
+
+        const T &front() const { return buffers[front_index]; }
+
+        // Only while neither side is running, e.g. to size the buffers.
+        std::array<T, 3> &all() { return buffers; }
+
+    private:
+        static constexpr uint8_t index_mask = 0x03;
+        static constexpr uint8_t fresh = 0x04;
+
+        std::array<T, 3> buffers { };
+        alignas(64) std::atomic<uint8_t> state { 1 };
+        alignas(64) uint8_t back_index = 0;
+        alignas(64) uint8_t front_index = 2;
+    };
+
+}
+
+#endif  // #ifndef _SNAPSHOT_H_
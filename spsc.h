@@ -0,0 +1,45 @@
+#ifndef _SPSC_H_
+#define _SPSC_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace ledstickler {
+
+    // Bounded lock-free queue for exactly one producer and one consumer
+    // thread. N must be a power of two, one slot is kept empty.
+    template<typename T, size_t N> class spsc_queue {
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+    public:
+        bool push(const T &v) {
+            const size_t t = tail.load(std::memory_order_relaxed);
+            const size_t n = (t + 1) & (N - 1);
+            if (n == head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            items[t] = v;
+            tail.store(n, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &v) {
+            const size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            v = items[h];
+            head.store((h + 1) & (N - 1), std::memory_order_release);
+            return true;
+        }
+
+        static constexpr size_t capacity() { return N - 1; }
+
+    private:
+        alignas(64) std::atomic<size_t> head { 0 };
+        alignas(64) std::atomic<size_t> tail { 0 };
+        alignas(64) T items[N] { };
+    };
+
+}
+
+#endif  // #ifndef _SPSC_H_
@@ -5,174 +5,438 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
-
-#if !defined(_MSC_VER)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wconversion" 
-#pragma GCC diagnostic ignored "-Wshadow"
-#if !defined(__clang__)
-#pragma GCC diagnostic ignored "-Wuseless-cast"
-#pragma GCC diagnostic ignored "-Wlogical-op"
-#endif  // #if !defined(__clang__)
-#endif  // #if !defined(_MSC_VER)
-#include <asio.hpp>
-#if !defined(_MSC_VER)
-#pragma GCC diagnostic pop
-#endif  // #if !defined(_MSC_VER)
+#include <memory>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 
 #include "./timeline.h"
 #include "./artnet.h"
 #include "./color.h"
+#include "./pool.h"
+#include "./sender.h"
+#include "./pacing.h"
+#include "./spsc.h"
+#include "./metrics.h"
+#include "./preview.h"
+#include "./serialize.h"
+#include "./output.h"
 
 namespace ledstickler {
  
-static asio::io_service io_service;
-static asio::ip::udp::socket socket(io_service);
-
-static size_t span_count = 0;
-static size_t point_count = 0;
-static vec4 color_sum = { 0 };
-
-template <typename T> static vec4 blend(const T &target, double time, const vec4 &top, const vec4 &btm) {
+template <typename T> static void blend_factors(const T &target, double time, plan_op &op) {
     double in_f = target.tim.lead_in > 0 ? ( time != 0.0 ? std::clamp(time / target.tim.lead_in, 0.0, 1.0) : 0.0 ) : 1.0;
     double etime = time - (target.tim.duration - target.tim.lead_out);
     double out_f = target.tim.lead_out > 0 ? ( etime != 0.0 ? std::clamp(1.0 - (etime / target.tim.lead_out) , 0.0, 1.0) : 1.0) : 1.0;
-    return target.blendFunc(target, top, btm, in_f, out_f);
+    op.in_f = float(in_f);
+    op.out_f = float(out_f);
+    op.blendMode = target.blendMode;
 }
 
-static std::stringstream ss;
+std::string timeline::json(const scene &s) const {
+    fmt::memory_buffer out;
+    write_json(s, out);
+    return fmt::to_string(out);
+}
 
-std::string timeline::json(fixture &f) const {
+render_context::render_context(const timeline &t, size_t threads) :
+    pool(threads),
+    worker_stats(pool.size()),
+    worker_scratch(pool.size(), std::vector<vec4f>(scene_chunk_size * (t.depth() + 1))) {
+}
 
-    ss.seekp(std::ios::beg); 
+frame_stats timeline::render(scene &s, double time, render_context &ctx) const {
+    std::fill(ctx.worker_stats.begin(), ctx.worker_stats.end(), frame_stats());
 
-    ss << "{\n";
-    ss << "\t\"bounds\":{\n";
-    ss << "\t\t\"xmin\":" << f.bounds.norm_uniform().xmin << ",\n";
-    ss << "\t\t\"xmax\":" << f.bounds.norm_uniform().xmax << ",\n";
-    ss << "\t\t\"ymin\":" << f.bounds.norm_uniform().ymin << ",\n";
-    ss << "\t\t\"ymax\":" << f.bounds.norm_uniform().ymax << ",\n";
-    ss << "\t\t\"zmin\":" << f.bounds.norm_uniform().zmin << ",\n";
-    ss << "\t\t\"zmax\":" << f.bounds.norm_uniform().zmax << "\n";
-    ss << "\t},\n";
+    const uint64_t t0 = metrics::now();
+    this->plan(time, ctx.plan);
+    for (const plan_op &op : ctx.plan.ops) {
+        if (op.kind == plan_op::evaluate) {
+            op.s->calcEffect->prepare(*op.s, op.time);
+        }
+    }
+    const uint64_t schedule_ns = metrics::now() - t0;
 
-    ss << "\t\"points\":[\n";
-    f.walk_fixtures( [&f] (const std::vector<const fixture *> &fixtures_stack) {
-        const auto &ft = *fixtures_stack.front();
-        if (!ft.name.size()) {
-            return;
+    // Two captures keep the lambda within std::function's inline storage, no allocation per frame
+    ctx.pool.run(s.chunks.size(), [&s, &ctx] (size_t job, size_t worker) {
+        const frame_plan &plan = ctx.plan;
+        const scene_chunk &chunk = s.chunks[job];
+        const point_batch points { s, s.fixtures[chunk.fixture].stack, chunk.first, chunk.count };
+        frame_stats &stats = ctx.worker_stats[worker];
+        const uint64_t e0 = metrics::now();
+        vec4f *out = &s.colors[chunk.first];
+        std::fill(out, out + chunk.count, vec4f());
+        plan.execute(points, out, ctx.worker_scratch[worker].data());
+        stats.span_count += plan.span_count * chunk.count;
+        for (size_t c = 0; c < chunk.count; c++) {
+            stats.color_sum += out[c];
         }
-        std::for_each(ft.points.begin(), ft.points.end(), [&f] (auto item) { 
-            static constexpr color_convert<uint8_t> convert;
-            const rgba<uint16_t> col(convert.CIELUV2LED(item.first));
-            ss << "\t\t{";
-            ss << "\"x\":" << f.bounds.map_norm_uniform(item.second).x << ",";
-            ss << "\"y\":" << f.bounds.map_norm_uniform(item.second).y << ",";
-            ss << "\"z\":" << f.bounds.map_norm_uniform(item.second).z << ",";
-            ss << "\"r\":" << col.r << ",";
-            ss << "\"g\":" << col.g << ",";
-            ss << "\"b\":" << col.b;
-            ss << "},\n";
-        });
+        stats.point_count += chunk.count;
+        const uint64_t e1 = metrics::now();
+        CIELUV2LED(&s.colors[chunk.first], &s.leds[chunk.first], chunk.count);
+        stats.evaluate_ns += e1 - e0;
+        stats.convert_ns += metrics::now() - e1;
     });
-    ss.seekp(-2, std::ios_base::end);
-    ss << "\n\t]\n";
-    ss << "}\n";
 
-    return ss.str();
+    frame_stats stats;
+    for (const auto &item : ctx.worker_stats) {
+        stats += item;
+    }
+    stats.schedule_ns = schedule_ns;
+    return stats;
 }
 
-void timeline::run(fixture &f, uint64_t frame_time_us) {
-    std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
-    std::chrono::system_clock::time_point frame_time = start_time;
+bool timeline::render_file(scene &s, const std::string &path, const offline_options &options) const {
+    render_context ctx(*this);
+    artnet_output artnet(s);
 
-    socket.open(asio::ip::udp::v4());
-    socket.non_blocking(true);
+    frame_writer writer;
+    if (!writer.open(path, options.format, options.frame_time_us, s, artnet)) {
+        return false;
+    }
 
-    for (;;) {
-        double time = double( std::chrono::duration_cast<std::chrono::microseconds>(frame_time - start_time).count() ) / 1'000'000.0;
-    
-        fflush(stdout); printf("\rtime (%fs)", time);
-        span_count = 0;
-        point_count = 0;
-        color_sum = { 0 };
-        
-        f.walk_points( [time, this] (const std::vector<const fixture *> &fixtures_stack, const vec4& point) {
-            point_count ++;
-            return calc(time, fixtures_stack, point, vec4());
-        });
-        
-        printf(" active spans (%d)", int(span_count / point_count));
+    const double duration = options.duration > 0.0 ? options.duration : tim.duration;
+    const uint64_t frames = uint64_t(std::ceil(duration * 1'000'000.0 / double(std::max(options.frame_time_us, uint64_t(1)))));
+
+    const uint64_t t0 = metrics::now();
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        const double time = double(frame * options.frame_time_us) / 1'000'000.0;
+        render(s, time, ctx);
+        if (options.format == frame_format::artnet) {
+            ctx.pool.run(artnet.universes.size(), [&s, &artnet] (size_t job, size_t) {
+                artnet.update(s, job);
+            });
+        }
+        if (!writer.write(time, s, artnet)) {
+            return false;
+        }
+    }
+    const double elapsed = double(metrics::now() - t0) / 1e9;
+
+    printf("rendered %llu frames (%fs of show) in %fs, %f frames/s\n", static_cast<unsigned long long>(frames), duration, elapsed, double(frames) / std::max(elapsed, 1e-9));
+    return writer.close();
+}
+
+bool timeline::play_file(scene &s, const std::string &path, const run_options &options, double start) const {
+    frame_file file;
+    if (!file.open(path) || !file.frame_count()) {
+        return false;
+    }
+    const frame_file_header &header = file.header();
+    if (header.format == frame_format::leds && header.element_count != s.size()) {
+        return false;
+    }
+
+    // One outgoing datagram per universe: a header the protocol owns plus a
+    // payload which for Art-Net files is read straight from the mapping.
+    std::vector<output_universe> universes;
+    artnet_output artnet(s);
+    if (header.format == frame_format::artnet) {
+        for (size_t c = 0; c < header.element_count; c++) {
+            const frame_file_universe &u = file.universes()[c];
+            universes.push_back({ u.universe, u.address });
+        }
+    } else {
+        universes = output_universes(artnet);
+    }
 
-        std::this_thread::sleep_until(frame_time);
-        frame_time += std::chrono::microseconds(frame_time_us);
+    udp_sender sender;
+    const std::unique_ptr<output_protocol> protocol = make_output_protocol(sender, universes, options.output);
 
-        f.walk_fixtures( [] (const std::vector<const fixture *> &fixtures_stack) {
-            if (fixtures_stack.size() == 0 || fixtures_stack.front() == nullptr) {
-                return;
+    metrics m;
+    metrics_reporter reporter(m, options.metrics_interval);
+
+    std::unique_ptr<preview_server> preview;
+    if (options.preview.port && header.format == frame_format::leds) {
+        preview = std::make_unique<preview_server>(s, options.preview);
+    }
+
+    const uint64_t frame_time_us = std::max(header.frame_time_us, uint64_t(1));
+    const size_t loop_frames = std::clamp(size_t(std::ceil(tim.duration * 1'000'000.0 / double(frame_time_us))), size_t(1), file.frame_count());
+    size_t index = size_t(std::max(start, 0.0) * 1'000'000.0 / double(frame_time_us)) % loop_frames;
+    uint64_t skipped = 0;
+
+    frame_pacer pacer(frame_time_us, options.overrun, options.spin_us);
+
+    for (;;) {
+        const uint8_t *payload = file.payload(index);
+
+        uint64_t t0 = metrics::now();
+        if (header.format == frame_format::leds) {
+            memcpy(static_cast<void *>(s.leds.data()), payload, s.leds.size() * sizeof(rgba<uint16_t>));
+            artnet.update(s);
+            if (preview) {
+                preview->publish(s, file.time(index));
             }
-            const auto &ft = *fixtures_stack.front();
-            if (!ft.name.size()) {
-                return;
+        }
+        m.record(metrics_stage::packetize, metrics::now() - t0);
+
+        t0 = metrics::now();
+        const bool send = pacer.wait();
+        m.record(metrics_stage::sleep, metrics::now() - t0);
+        m.jitter.record(uint64_t(std::max(pacer.stats().jitter_us, int64_t(0))) * 1000);
+
+        if (send) {
+            for (size_t c = 0; c < universes.size(); c++) {
+                if (header.format == frame_format::artnet) {
+                    const frame_file_universe &u = file.universes()[c];
+                    protocol->queue(c, payload + u.offset - sizeof(double), u.length);
+                } else {
+                    const artnet_universe &a = artnet.universes[c];
+                    protocol->queue(c, a.packet.data() + artnet_dmx_header_size, a.size - artnet_dmx_header_size);
+                }
             }
-            auto packets = create_artnet_output_packets(ft);
-            for (auto packet : packets) {
-                try {
-                    socket.send_to(asio::buffer(static_cast<const void *>(packet.data()), packet.size()),
-                        asio::ip::udp::endpoint(asio::ip::make_address_v4(ft.address.addr()), artnet_port));
+            protocol->sync();
+
+            t0 = metrics::now();
+            const send_stats sent = sender.flush();
+            m.record(metrics_stage::send, metrics::now() - t0);
+            m.packets.fetch_add(sent.packets, std::memory_order_relaxed);
+            m.bytes.fetch_add(sent.bytes, std::memory_order_relaxed);
+            m.send_calls.fetch_add(sent.calls, std::memory_order_relaxed);
+            m.send_again.fetch_add(sent.again, std::memory_order_relaxed);
+            m.send_partial.fetch_add(sent.partial, std::memory_order_relaxed);
+            m.send_errors.fetch_add(sent.errors, std::memory_order_relaxed);
+        }
+        pacer.advance();
+
+        const pacing_stats &ps = pacer.stats();
+        m.frames.fetch_add(1, std::memory_order_relaxed);
+        m.time.store(file.time(index), std::memory_order_relaxed);
+        m.late.store(ps.late, std::memory_order_relaxed);
+        m.dropped.store(ps.dropped, std::memory_order_relaxed);
+        m.skipped.store(ps.skipped, std::memory_order_relaxed);
+
+        // Skipped periods move playback on as well so it stays on the clock
+        index = (index + 1 + (ps.skipped - skipped)) % loop_frames;
+        skipped = ps.skipped;
+    }
+}
+
+// Pipeline stages spin briefly and then back off to short sleeps while
+// waiting on each other, the render stage does this for most of every frame.
+template <typename F> static void wait_for(const F &ready) {
+    for (size_t c = 0; !ready(); c++) {
+        if (c < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+// A rendered frame in flight between the render and transmit stages.
+struct frame_slot {
+    double time = 0.0;
+    frame_stats stats;
+    artnet_output artnet;
+
+    explicit frame_slot(const scene &s) : artnet(s) { }
+};
+
+void timeline::run(scene &s, const run_options &options) {
+
+    render_context ctx(*this);
+
+    // Slots cycle render -> filled -> transmit -> free -> render. With n slots
+    // the render stage can be up to n-1 frames ahead of the wire.
+    using slot_queue = spsc_queue<size_t, 8>;
+    const size_t slot_count = std::clamp(options.pipeline_depth, size_t(2), slot_queue::capacity());
+    std::vector<frame_slot> slots(slot_count, frame_slot(s));
+    slot_queue free_slots;
+    slot_queue filled_slots;
+    for (size_t c = 0; c < slot_count; c++) {
+        free_slots.push(c);
+    }
+
+    // Periods the transmit stage skipped, the render stage moves show time on by as many.
+    std::atomic<uint64_t> skipped_frames { 0 };
+
+    metrics m;
+    metrics_reporter reporter(m, options.metrics_interval);
+
+    std::unique_ptr<preview_server> preview;
+    if (options.preview.port) {
+        preview = std::make_unique<preview_server>(s, options.preview);
+    }
+
+    std::thread transmit([&s, &options, &slots, &free_slots, &filled_slots, &skipped_frames, &m] {
+        udp_sender sender;
+        const std::unique_ptr<output_protocol> protocol = make_output_protocol(sender, output_universes(slots.front().artnet), options.output);
+        frame_pacer pacer(options.frame_time_us, options.overrun, options.spin_us);
+
+        const uint64_t keepalive_frames = options.keepalive_us ? std::max(options.keepalive_us / std::max(options.frame_time_us, uint64_t(1)), uint64_t(1)) : 0;
+        artnet_delta delta(slots.front().artnet, keepalive_frames);
+
+        for (;;) {
+            size_t index = 0;
+            wait_for([&filled_slots, &index] { return filled_slots.pop(index); });
+            frame_slot &slot = slots[index];
+
+            uint64_t t0 = metrics::now();
+            const bool send = pacer.wait();
+            m.record(metrics_stage::sleep, metrics::now() - t0);
+            m.jitter.record(uint64_t(std::max(pacer.stats().jitter_us, int64_t(0))) * 1000);
+
+            if (send) {
+                delta.update(slot.artnet);
+
+                for (size_t c = 0; c < slot.artnet.universes.size(); c++) {
+                    if (delta.send[c]) {
+                        const artnet_universe &u = slot.artnet.universes[c];
+                        protocol->queue(c, u.packet.data() + artnet_dmx_header_size, u.size - artnet_dmx_header_size);
+                    }
                 }
-                catch (...) {
+
+                // Nothing to latch if every universe was held back
+                if (delta.suppressed < slot.artnet.universes.size()) {
+                    protocol->sync();
                 }
-            }
-        });
 
-        f.walk_fixtures( [] (const std::vector<const fixture *> &fixtures_stack) {
-            if (fixtures_stack.size() == 0 || fixtures_stack.front() == nullptr) {
-                return;
-            }
-            const auto &ft = *fixtures_stack.front();
-            if (!ft.name.size()) {
-                return;
-            }
-            std::for_each(ft.points.begin(), ft.points.end(), [] (auto item) { color_sum += item.first; } );
-            constexpr auto sync_packet = make_arnet_sync_packet();
-            try {
-                socket.send_to(asio::buffer(static_cast<const void *>(sync_packet.data()), artnet_sync_packet_size),
-                    asio::ip::udp::endpoint(asio::ip::make_address_v4(ft.address.addr()), artnet_port));
+                t0 = metrics::now();
+                const send_stats sent = sender.flush();
+                m.record(metrics_stage::send, metrics::now() - t0);
+                m.packets.fetch_add(sent.packets, std::memory_order_relaxed);
+                m.bytes.fetch_add(sent.bytes, std::memory_order_relaxed);
+                m.send_calls.fetch_add(sent.calls, std::memory_order_relaxed);
+                m.send_again.fetch_add(sent.again, std::memory_order_relaxed);
+                m.send_partial.fetch_add(sent.partial, std::memory_order_relaxed);
+                m.send_errors.fetch_add(sent.errors, std::memory_order_relaxed);
+                m.suppressed.fetch_add(delta.suppressed, std::memory_order_relaxed);
             }
-            catch (...) {
-            }
-        });
+            pacer.advance();
+
+            const pacing_stats &ps = pacer.stats();
+            skipped_frames.store(ps.skipped, std::memory_order_relaxed);
+            m.late.store(ps.late, std::memory_order_relaxed);
+            m.dropped.store(ps.dropped, std::memory_order_relaxed);
+            m.skipped.store(ps.skipped, std::memory_order_relaxed);
+
+            const frame_stats &stats = slot.stats;
+            static constexpr color_convert<uint8_t> convert;
+            const rgba<uint16_t> col(convert.CIELUV2LED(vec4(stats.color_sum) / double(std::max(stats.point_count, size_t(1)))));
+            m.frames.fetch_add(1, std::memory_order_relaxed);
+            m.time.store(slot.time, std::memory_order_relaxed);
+            m.active_spans.store(stats.span_count / std::max(stats.point_count, size_t(1)), std::memory_order_relaxed);
+            m.average_color.store((uint64_t(col.r) << 32) | (uint64_t(col.g) << 16) | uint64_t(col.b), std::memory_order_relaxed);
+
+            free_slots.push(index);
+        }
+    });
+
+    const double frame_time = double(options.frame_time_us) / 1'000'000.0;
+    uint64_t frame = 0;
+    uint64_t skipped = 0;
+    double loop_start = 0.0;
+
+    for (;;) {
+        size_t index = 0;
+        wait_for([&free_slots, &index] { return free_slots.pop(index); });
+        frame_slot &slot = slots[index];
+
+        const uint64_t now_skipped = skipped_frames.load(std::memory_order_relaxed);
+        frame += now_skipped - skipped;
+        skipped = now_skipped;
 
-        static constexpr color_convert<uint8_t> convert;
-        const rgba<uint16_t> col(convert.CIELUV2LED(color_sum / double(point_count)));
-        printf(" average color (r:%04x g:%04x b:%04x)", col.r, col.g, col.b);
-        
-        if (time > tim.duration) {
-            start_time = std::chrono::system_clock::now();
-            frame_time = start_time;
+        // Wrap by exactly one show length so time stays continuous across the loop
+        double time = double(frame) * frame_time - loop_start;
+        while (time >= tim.duration) {
+            loop_start += tim.duration;
+            time -= tim.duration;
         }
+
+        slot.time = time;
+        slot.stats = render(s, time, ctx);
+        m.record(metrics_stage::schedule, slot.stats.schedule_ns);
+        m.record(metrics_stage::evaluate, slot.stats.evaluate_ns);
+        m.record(metrics_stage::convert, slot.stats.convert_ns);
+
+        if (preview) {
+            preview->publish(s, time);
+        }
+
+        const uint64_t t0 = metrics::now();
+        ctx.pool.run(slot.artnet.universes.size(), [&s, &slot] (size_t job, size_t) {
+            slot.artnet.update(s, job);
+        });
+        m.record(metrics_stage::packetize, metrics::now() - t0);
+
+        filled_slots.push(index);
+        frame++;
     }
+}
+
+size_t timeline::depth() const {
+    size_t d = 0;
+    for (auto& item : timelines) {
+        d = std::max(d, item.depth());
+    }
+    return d + 1;
+}
 
-    socket.close();
+void timeline::plan(double time, frame_plan &p) const {
+    p.ops.clear();
+    p.span_count = 0;
+    p.depth = 0;
+    append_plan(time, p, 1);
 }
 
-vec4 timeline::calc(double time, const std::vector<const fixture *> &fixtures_stack, const vec4& point, vec4 btm) {
-    vec4 res;
+void timeline::append_plan(double time, frame_plan &p, size_t level) const {
+    p.depth = std::max(p.depth, level);
+
+    plan_op op;
+    op.kind = plan_op::begin;
+    p.ops.push_back(op);
+
     for (auto& item : spans) {
         if (time >=  item.tim.start &&
             time <  (item.tim.start + item.tim.duration) ) {
-            span_count ++;
-            res = blend(item, time - item.tim.start, item.calcFunc(item, fixtures_stack, point, time - item.tim.start), res);
+            op.kind = plan_op::evaluate;
+            op.time = time - item.tim.start;
+            op.s = &item;
+            blend_factors(item, op.time, op);
+            p.ops.push_back(op);
+            p.span_count++;
         }
     }
     for (auto& item : timelines) {
         if (time >=  item.tim.start &&
             time <  (item.tim.start + item.tim.duration) ) {
-            res = item.calc(time - item.tim.start, fixtures_stack, point, res);
+            item.append_plan(time - item.tim.start, p, level + 1);
+        }
+    }
+
+    op.kind = plan_op::end;
+    op.time = time;
+    op.s = nullptr;
+    blend_factors(*this, time, op);
+    p.ops.push_back(op);
+}
+
+void frame_plan::execute(const point_batch &points, vec4f *out, vec4f *scratch) const {
+    // Layer 0 is out itself, layer n lives in scratch, the top of scratch holds the span output.
+    vec4f *top = scratch + scene_chunk_size * depth;
+    size_t level = 0;
+    auto layer = [&] (size_t l) {
+        return l == 0 ? out : scratch + scene_chunk_size * (l - 1);
+    };
+    for (const plan_op &op : ops) {
+        switch (op.kind) {
+            case plan_op::begin:
+                level++;
+                std::fill(layer(level), layer(level) + points.count, vec4f());
+                break;
+            case plan_op::evaluate:
+                op.s->calcEffect->evaluate(*op.s, points, top, op.time);
+                op.blendMode->blend(top, layer(level), points.count, op.in_f, op.out_f);
+                break;
+            case plan_op::end:
+                op.blendMode->blend(layer(level), layer(level - 1), points.count, op.in_f, op.out_f);
+                level--;
+                break;
         }
     }
-    return blend(*this, time, res, btm);
 }
 
 }
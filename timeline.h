@@ -1,10 +1,22 @@
 #ifndef TIMELINE_H_
 #define TIMELINE_H_
 
+#include "./vec4f.h"
 #include "./fixture.h"
+#include "./scene.h"
+#include "./artnet.h"
+#include "./effect.h"
+#include "./pacing.h"
+#include "./pool.h"
+#include "./color.h"
+#include "./framefile.h"
+#include "./gradient.h"
+#include "./preview.h"
+#include "./output.h"
 
 #include <cstdint>
-#include <functional>
+#include <memory>
+#include <string>
 
 namespace ledstickler {
 
@@ -62,15 +74,49 @@ namespace ledstickler {
         double lead_out = 0.0;
     };
     
+    struct run_options {
+        uint64_t frame_time_us = 10'000;
+        overrun_policy overrun = overrun_policy::run_late;
+        uint64_t spin_us = 500; // busy wait this long before each deadline instead of sleeping
+        size_t pipeline_depth = 3; // frame buffers between render and transmit, 2 to 7
+        uint64_t keepalive_us = 1'000'000; // resend unchanged universes this often, 0 sends every frame
+        output_options output; // wire protocol, Art-Net unless set otherwise
+        double metrics_interval = 1.0; // seconds between metrics dumps, 0 dumps only on SIGUSR1
+        preview_options preview;
+    };
+
+    struct offline_options {
+        uint64_t frame_time_us = 10'000;
+        double duration = 0.0; // 0 renders the timeline's own duration
+        frame_format format = frame_format::leds;
+    };
+
+    // Per worker render statistics, reduced once at the end of a frame.
+    struct alignas(64) frame_stats {
+        size_t span_count = 0;
+        size_t point_count = 0;
+        vec4f color_sum = { 0 };
+        uint64_t schedule_ns = 0;
+        uint64_t evaluate_ns = 0;
+        uint64_t convert_ns = 0;
+
+        frame_stats &operator+=(const frame_stats &b) {
+            span_count += b.span_count;
+            point_count += b.point_count;
+            color_sum += b.color_sum;
+            schedule_ns += b.schedule_ns;
+            evaluate_ns += b.evaluate_ns;
+            convert_ns += b.convert_ns;
+            return *this;
+        }
+    };
+
     struct span {
         timing tim;
 
-        std::function<vec4 (const span &s, const std::vector<const fixture *> &fixtures_stack, const vec4& point, double time)> calcFunc;
-        
-        std::function<vec4 (const span &s, const vec4 &top, const vec4 &btm, double in_f, double out_f)> blendFunc = 
-            [] (const span &, const vec4 &top, const vec4 &btm, double in_f, double out_f) {
-                return btm + top * in_f * out_f;
-            };
+        const effect *calcEffect = nullptr;
+        const blender *blendMode = blender_of<blend_add>();
+        const gradient<> *grad = nullptr; // for effects driven by a show file gradient
 
         vec4 param0 = { 0 };
         vec4 param1 = { 0 };
@@ -78,17 +124,76 @@ namespace ledstickler {
         vec4 param3 = { 0 };
     };
 
+    // One step of a frame_plan. begin pushes an empty layer, evaluate blends
+    // a span into the top layer, end blends the top layer onto the one below.
+    struct plan_op {
+        enum kind_t : uint8_t {
+            begin,
+            evaluate,
+            end
+        };
+        kind_t kind = begin;
+        float in_f = 1.0f;
+        float out_f = 1.0f;
+        double time = 0.0;
+        const span *s = nullptr;
+        const blender *blendMode = nullptr;
+    };
+
+    // The active spans of a timeline at one point in time, flattened with their
+    // local times and lead in/out factors. Built once per frame, then executed
+    // for every batch of points.
+    struct frame_plan {
+        std::vector<plan_op> ops;
+        size_t span_count = 0;
+        size_t depth = 0;
+
+        // Blends the plan over out. scratch must hold scene_chunk_size * (depth + 1) entries.
+        void execute(const point_batch &points, vec4f *out, vec4f *scratch) const;
+    };
+
+    class timeline;
+
+    // Everything timeline::render needs besides the scene, allocated once.
+    struct render_context {
+        explicit render_context(const timeline &t, size_t threads = std::thread::hardware_concurrency());
+
+        worker_pool pool;
+        std::vector<frame_stats> worker_stats;
+        std::vector<std::vector<vec4f>> worker_scratch;
+        frame_plan plan;
+    };
+
     class timeline {
     public:
-        void run(fixture &fixture, uint64_t frame_time_us);
+        void run(scene &s, const run_options &options);
+
+        // Renders one frame at time into s.colors and s.leds.
+        frame_stats render(scene &s, double time, render_context &ctx) const;
 
-        vec4 calc(double time, const std::vector<const fixture *> &fixtures_stack, const vec4& point, vec4 btm); 
+        // Renders at a fixed timestep as fast as possible into a frame file,
+        // without sockets or frame pacing. Returns false on I/O errors.
+        bool render_file(scene &s, const std::string &path, const offline_options &options) const;
+
+        // Plays a frame file written by render_file live, looping every
+        // tim.duration and starting at start seconds. Art-Net files are sent
+        // straight from the mapping, LED files are packetized for s, either
+        // in the protocol options.output picks. The frame time comes from
+        // the file. Returns false if path can not be played.
+        bool play_file(scene &s, const std::string &path, const run_options &options, double start = 0.0) const;
+
+        // Fills plan with what is active at time, reusing its storage.
+        void plan(double time, frame_plan &p) const;
+
+        size_t depth() const;
 
         template<typename T, typename ... Tplus> void push(T item, Tplus ... rest) {
             push(item);
             push(rest ...);
         }
 
+        timeline() = default;
+
         template<typename ... Tplus> timeline(Tplus ... rest) {
             push(rest ...);
         }
@@ -105,19 +210,21 @@ namespace ledstickler {
             timelines.push_back(t);
         }
 
-        void push(std::function<vec4 (const timeline &t, const vec4 &top, const vec4 &btm, double in_f, double out_f)> f) {
-            blendFunc = f;
+        void push(const blender *b) {
+            blendMode = b;
         }
 
-        std::string json(fixture &f) const;
+        // write_json into a string, tools that dump repeatedly should call
+        // write_json or write_geometry/write_frame with a buffer of their own.
+        std::string json(const scene &s) const;
 
         timing tim;
         std::vector<timeline> timelines;
         std::vector<span> spans;
-        std::function<vec4 (const timeline &t, const vec4 &top, const vec4 &btm, double in_f, double out_f)> blendFunc =
-            [] (const timeline &, const vec4 &top, const vec4 &btm, double in_f, double out_f) {
-                return btm + top * in_f * out_f;
-            };
+        const blender *blendMode = blender_of<blend_add>();
+
+    private:
+        void append_plan(double time, frame_plan &p, size_t level) const;
     };
 
 }
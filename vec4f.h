@@ -0,0 +1,182 @@
+#ifndef _VEC4F_H_
+#define _VEC4F_H_
+
+#include "./vec4.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VEC4F_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define VEC4F_NEON
+#include <arm_neon.h>
+#endif  // #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+namespace ledstickler {
+
+    // Single precision, 16-byte aligned counterpart of vec4 for the render
+    // path. Construction and conversion are constexpr so tables can still be
+    // built at compile time in double, arithmetic goes through SSE or NEON.
+    struct alignas(16) vec4f {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+        float w = 0.0f;
+
+        constexpr vec4f() {
+        }
+
+        constexpr vec4f(float v) :
+            x(v),
+            y(v),
+            z(v),
+            w(v) {
+        }
+
+        constexpr vec4f(float _x, float _y, float _z, float _w = 0.0f) :
+            x(_x),
+            y(_y),
+            z(_z),
+            w(_w) {
+        }
+
+        constexpr explicit vec4f(const vec4 &v) :
+            x(float(v.x)),
+            y(float(v.y)),
+            z(float(v.z)),
+            w(float(v.w)) {
+        }
+
+        constexpr explicit operator vec4() const {
+            return vec4(double(x), double(y), double(z), double(w));
+        }
+
+        constexpr vec4f &operator=(const vec4f& other) = default;
+
+#if defined(VEC4F_SSE)
+        using simd_t = __m128;
+        explicit vec4f(simd_t v) { _mm_store_ps(&x, v); }
+        simd_t simd() const { return _mm_load_ps(&x); }
+        static simd_t splat(float v) { return _mm_set1_ps(v); }
+        static simd_t add(simd_t a, simd_t b) { return _mm_add_ps(a, b); }
+        static simd_t sub(simd_t a, simd_t b) { return _mm_sub_ps(a, b); }
+        static simd_t mul(simd_t a, simd_t b) { return _mm_mul_ps(a, b); }
+        static simd_t div(simd_t a, simd_t b) { return _mm_div_ps(a, b); }
+        static simd_t min(simd_t a, simd_t b) { return _mm_min_ps(a, b); }
+        static simd_t max(simd_t a, simd_t b) { return _mm_max_ps(a, b); }
+#elif defined(VEC4F_NEON)
+        using simd_t = float32x4_t;
+        explicit vec4f(simd_t v) { vst1q_f32(&x, v); }
+        simd_t simd() const { return vld1q_f32(&x); }
+        static simd_t splat(float v) { return vdupq_n_f32(v); }
+        static simd_t add(simd_t a, simd_t b) { return vaddq_f32(a, b); }
+        static simd_t sub(simd_t a, simd_t b) { return vsubq_f32(a, b); }
+        static simd_t mul(simd_t a, simd_t b) { return vmulq_f32(a, b); }
+        static simd_t div(simd_t a, simd_t b) { return vdivq_f32(a, b); }
+        static simd_t min(simd_t a, simd_t b) { return vminq_f32(a, b); }
+        static simd_t max(simd_t a, simd_t b) { return vmaxq_f32(a, b); }
+#else  // #if defined(VEC4F_SSE)
+        struct simd_t { float x, y, z, w; };
+        explicit vec4f(simd_t v) : x(v.x), y(v.y), z(v.z), w(v.w) { }
+        simd_t simd() const { return { x, y, z, w }; }
+        static simd_t splat(float v) { return { v, v, v, v }; }
+        static simd_t add(simd_t a, simd_t b) { return { a.x+b.x, a.y+b.y, a.z+b.z, a.w+b.w }; }
+        static simd_t sub(simd_t a, simd_t b) { return { a.x-b.x, a.y-b.y, a.z-b.z, a.w-b.w }; }
+        static simd_t mul(simd_t a, simd_t b) { return { a.x*b.x, a.y*b.y, a.z*b.z, a.w*b.w }; }
+        static simd_t div(simd_t a, simd_t b) { return { a.x/b.x, a.y/b.y, a.z/b.z, a.w/b.w }; }
+        static simd_t min(simd_t a, simd_t b) { return { std::min(a.x,b.x), std::min(a.y,b.y), std::min(a.z,b.z), std::min(a.w,b.w) }; }
+        static simd_t max(simd_t a, simd_t b) { return { std::max(a.x,b.x), std::max(a.y,b.y), std::max(a.z,b.z), std::max(a.w,b.w) }; }
+#endif  // #if defined(VEC4F_SSE)
+
+        vec4f &operator+=(const vec4f &b) {
+            return *this = vec4f(add(simd(), b.simd()));
+        }
+
+        vec4f &operator-=(const vec4f &b) {
+            return *this = vec4f(sub(simd(), b.simd()));
+        }
+
+        vec4f &operator*=(const vec4f &b) {
+            return *this = vec4f(mul(simd(), b.simd()));
+        }
+
+        vec4f &operator/=(const vec4f &b) {
+            return *this = vec4f(div(simd(), b.simd()));
+        }
+
+        vec4f &operator*=(float v) {
+            return *this = vec4f(mul(simd(), splat(v)));
+        }
+
+        vec4f operator-() const {
+            return vec4f(sub(splat(0.0f), simd()));
+        }
+
+        vec4f operator+(float v) const {
+            return vec4f(add(simd(), splat(v)));
+        }
+
+        vec4f operator-(float v) const {
+            return vec4f(sub(simd(), splat(v)));
+        }
+
+        vec4f operator*(float v) const {
+            return vec4f(mul(simd(), splat(v)));
+        }
+
+        vec4f operator/(float v) const {
+            return vec4f(div(simd(), splat(v)));
+        }
+
+        vec4f operator+(const vec4f &b) const {
+            return vec4f(add(simd(), b.simd()));
+        }
+
+        vec4f operator-(const vec4f &b) const {
+            return vec4f(sub(simd(), b.simd()));
+        }
+
+        vec4f operator*(const vec4f &b) const {
+            return vec4f(mul(simd(), b.simd()));
+        }
+
+        vec4f operator/(const vec4f &b) const {
+            return vec4f(div(simd(), b.simd()));
+        }
+
+        vec4f min(const vec4f &b) const {
+            return vec4f(min(simd(), b.simd()));
+        }
+
+        vec4f max(const vec4f &b) const {
+            return vec4f(max(simd(), b.simd()));
+        }
+
+        vec4f clamp() const {
+            return vec4f(min(max(simd(), splat(0.0f)), splat(1.0f)));
+        }
+
+        vec4f lerp(const vec4f &b, float v) const {
+            return lerp(*this, b, v);
+        }
+
+        static vec4f lerp(const vec4f &a, const vec4f &b, float v) {
+            const simd_t as = a.simd();
+            return vec4f(add(as, mul(sub(b.simd(), as), splat(v))));
+        }
+
+        constexpr static vec4f zero() {
+            return vec4f(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        constexpr static vec4f one() {
+            return vec4f(1.0f, 1.0f, 1.0f, 1.0f);
+        }
+    };
+
+}
+
+#endif  // #ifndef _VEC4F_H_